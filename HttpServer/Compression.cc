@@ -0,0 +1,322 @@
+#include "Compression.h"
+#include "HttpConnection.h"
+#include "HttpHeaders.h"
+#include "base/Logging.h"
+
+#include <errno.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+
+namespace
+{
+
+const char* const kCompressibleTypes[] = {
+  "application/javascript",
+  "application/json",
+  "application/rtf",
+  "application/xhtml+xml",
+  "application/vnd.ms-fontobject",
+  "image/svg+xml",
+  "image/x-icon",
+  "font/ttf",
+  "font/otf",
+};
+
+boost::string_view trim(boost::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+// qvalue = ( "0" [ "." 0*3DIGIT ] ) / ( "1" [ "." 0*3("0") ] )，这里只需区分是否为 0
+bool zeroQuality(boost::string_view params) {
+  while (!params.empty()) {
+    size_t semi = params.find(';');
+    boost::string_view param = trim(params.substr(0, semi));
+    params.remove_prefix(semi == boost::string_view::npos ? params.size() : semi + 1);
+
+    if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+      boost::string_view q = param.substr(2);
+      return !q.empty() && q[0] == '0' && q.find_first_not_of("0.", 1) == boost::string_view::npos;
+    }
+  }
+  return false;
+}
+
+bool readFile(const std::string& path, std::string* out) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  char buf[64 * 1024];
+  ssize_t n;
+  while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+    out->append(buf, static_cast<size_t>(n));
+  }
+  ::close(fd);
+  return n == 0;
+}
+
+bool gzip(const std::string& in, std::string* out) {
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  out->resize(deflateBound(&zs, in.size()));
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+  zs.avail_in = static_cast<uInt>(in.size());
+  zs.next_out = reinterpret_cast<Bytef*>(&(*out)[0]);
+  zs.avail_out = static_cast<uInt>(out->size());
+  int ret = deflate(&zs, Z_FINISH);
+  out->resize(zs.total_out);
+  deflateEnd(&zs);
+  return ret == Z_STREAM_END;
+}
+
+// 先写临时文件再 rename，FileCache 不会看到写了一半的 .gz
+bool writeFileAtomic(const std::string& path, const std::string& data, mode_t mode) {
+  std::string tmp = path + ".tmp";
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = ::fchmod(fd, mode) == 0
+            && ::write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+  ok = ::close(fd) == 0 && ok;
+  if (!ok || ::rename(tmp.c_str(), path.c_str()) < 0) {
+    ::unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool newerOrEqual(const struct stat& lhs, const struct stat& rhs) {
+  return lhs.st_mtim.tv_sec > rhs.st_mtim.tv_sec
+         || (lhs.st_mtim.tv_sec == rhs.st_mtim.tv_sec && lhs.st_mtim.tv_nsec >= rhs.st_mtim.tv_nsec);
+}
+
+size_t precompressDir(const std::string& dir, size_t minSize) {
+  DIR* d = ::opendir(dir.c_str());
+  if (d == nullptr) {
+    LOG_SYSERR << "Compression::precompressTree(), opendir " << dir;
+    return 0;
+  }
+
+  size_t generated = 0;
+  while (struct dirent* e = ::readdir(d)) {
+    boost::string_view name(e->d_name);
+    if (name == "." || name == ".." || name.ends_with(".gz") || name.ends_with(".tmp")) {
+      continue;
+    }
+    std::string path = dir + "/" + e->d_name;
+    struct stat st;
+    if (::stat(path.c_str(), &st) < 0) {
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      generated += precompressDir(path, minSize);
+      continue;
+    }
+    if (!S_ISREG(st.st_mode) || static_cast<size_t>(st.st_size) < minSize
+        || !HttpConnection::compressible(name)) {
+      continue;
+    }
+
+    std::string gzPath = path + ".gz";
+    struct stat gzStat;
+    if (::stat(gzPath.c_str(), &gzStat) == 0 && newerOrEqual(gzStat, st)) {
+      continue;
+    }
+
+    std::string content, compressed;
+    if (!readFile(path, &content) || !gzip(content, &compressed)) {
+      LOG_ERROR << "Compression::precompressTree(), failed to compress " << path;
+      continue;
+    }
+    if (compressed.size() >= content.size()) {
+      continue;
+    }
+    if (!writeFileAtomic(gzPath, compressed, st.st_mode & 0777)) {
+      LOG_SYSERR << "Compression::precompressTree(), write " << gzPath;
+      continue;
+    }
+    LOG_INFO << "precompressed " << path << ": " << content.size() << " -> " << compressed.size();
+    ++generated;
+  }
+  ::closedir(d);
+  return generated;
+}
+
+} // namespace
+
+
+bool Compression::compressibleType(boost::string_view mimeType) {
+  if (mimeType.starts_with("text/")) {
+    return true;
+  }
+  for (const char* type : kCompressibleTypes) {
+    if (mimeType == type) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Compression::acceptsGzip(boost::string_view acceptEncoding) {
+  bool star = false;
+  while (!acceptEncoding.empty()) {
+    size_t comma = acceptEncoding.find(',');
+    boost::string_view item = acceptEncoding.substr(0, comma);
+    acceptEncoding.remove_prefix(comma == boost::string_view::npos ? acceptEncoding.size() : comma + 1);
+
+    size_t semi = item.find(';');
+    boost::string_view coding = trim(item.substr(0, semi));
+    boost::string_view params = semi == boost::string_view::npos ? boost::string_view() : item.substr(semi + 1);
+    if (HttpHeaders::equalsIgnoreCase(coding, "gzip") || HttpHeaders::equalsIgnoreCase(coding, "x-gzip")) {
+      return !zeroQuality(params);  // 明确列出的 gzip 优先于 "*"
+    }
+    if (coding == "*") {
+      star = !zeroQuality(params);
+    }
+  }
+  return star;
+}
+
+size_t Compression::precompressTree(const std::string& root, size_t minSize) {
+  return precompressDir(root, minSize);
+}
+
+
+const size_t GzipCompressor::kChunkSize;
+const size_t GzipCompressor::kEntryOverhead;
+
+GzipCompressor::GzipCompressor(int level, size_t cacheCapacity)
+  : initialized_(false),
+    cacheCapacity_(cacheCapacity),
+    cacheBytes_(0),
+    hits_(0),
+    misses_(0)
+{
+  memset(&stream_, 0, sizeof(stream_));
+  initialized_ = deflateInit2(&stream_, level, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+  if (!initialized_) {
+    LOG_ERROR << "GzipCompressor::GzipCompressor(), deflateInit2 failed";
+  }
+}
+
+GzipCompressor::~GzipCompressor() {
+  LOG_INFO << "GzipCompressor: hits = " << hits_ << ", misses = " << misses_
+           << ", cached = " << lru_.size() << " (" << cacheBytes_ << " bytes)";
+  if (initialized_) {
+    deflateEnd(&stream_);
+  }
+}
+
+GzipCompressor::Output GzipCompressor::compressFile(int fd, const struct stat& st) {
+  if (!initialized_) {
+    return Output();
+  }
+
+  const size_t size = static_cast<size_t>(st.st_size);
+  Key key = { size, static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+              static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000 + static_cast<uint64_t>(st.st_mtim.tv_nsec) };
+  bool found = false;
+  Output output = lookup(key, &found);
+  if (found) {
+    return output;
+  }
+
+  scratch_.resize(size);
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = ::pread(fd, scratch_.data() + done, size - done, static_cast<off_t>(done));
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      LOG_SYSERR << "GzipCompressor::compressFile(), pread";
+      return Output();
+    }
+    done += static_cast<size_t>(n);
+  }
+  output = deflateIfSmaller(scratch_.data(), size);
+  insert(key, output);  // 不可压缩的文件也记下，下次直接发送原文件
+  return output;
+}
+
+GzipCompressor::Output GzipCompressor::lookup(const Key& key, bool* found) {
+  auto it = index_.find(key);
+  *found = it != index_.end();
+  if (!*found) {
+    ++misses_;
+    return Output();
+  }
+  ++hits_;
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return it->second->second;
+}
+
+GzipCompressor::Output GzipCompressor::deflateIfSmaller(const char* data, size_t len) {
+  std::shared_ptr<std::string> out = std::make_shared<std::string>();
+  if (!deflateAll(data, len, out.get()) || out->size() >= len) {
+    return Output();
+  }
+  return out;
+}
+
+// 按 kChunkSize 分段送入 deflate，输出随写随扩
+bool GzipCompressor::deflateAll(const char* data, size_t len, std::string* out) {
+  if (deflateReset(&stream_) != Z_OK) {
+    return false;
+  }
+  out->reserve(len / 3 + 64);
+
+  size_t consumed = 0;
+  int ret = Z_OK;
+  while (ret != Z_STREAM_END) {
+    size_t in = std::min(kChunkSize, len - consumed);
+    stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data + consumed));
+    stream_.avail_in = static_cast<uInt>(in);
+    consumed += in;
+    int flush = consumed == len ? Z_FINISH : Z_NO_FLUSH;
+
+    do {
+      size_t used = out->size();
+      out->resize(used + kChunkSize);
+      stream_.next_out = reinterpret_cast<Bytef*>(&(*out)[used]);
+      stream_.avail_out = static_cast<uInt>(kChunkSize);
+      ret = deflate(&stream_, flush);
+      if (ret == Z_STREAM_ERROR) {
+        return false;
+      }
+      out->resize(used + kChunkSize - stream_.avail_out);
+    } while (stream_.avail_out == 0);
+  }
+  return true;
+}
+
+void GzipCompressor::insert(const Key& key, const Output& output) {
+  size_t bytes = (output ? output->size() : 0) + kEntryOverhead;
+  if (bytes > cacheCapacity_) {
+    return;
+  }
+  lru_.emplace_front(key, output);
+  index_.emplace(key, lru_.begin());
+  cacheBytes_ += bytes;
+  while (cacheBytes_ > cacheCapacity_) {
+    cacheBytes_ -= (lru_.back().second ? lru_.back().second->size() : 0) + kEntryOverhead;
+    index_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+}
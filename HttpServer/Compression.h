@@ -0,0 +1,94 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include "base/noncopyable.h"
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <zlib.h>
+#include <boost/utility/string_view.hpp>
+
+// 响应压缩相关的工具函数，压缩格式只支持 gzip（zlib）
+// 静态文件使用预先生成的 "xxx.gz" 兄弟文件，与原文件走同样的 FileCache / sendfile / ResponseCache 路径
+// 没有 .gz 的响应（错误页面、POST 结果、动态内容）由 GzipCompressor 在发送前压缩
+
+namespace Compression
+{
+  bool compressibleType(boost::string_view mimeType);  // 文本类及未压缩的字体/图标
+  bool acceptsGzip(boost::string_view acceptEncoding);  // 按 q 值判断 Accept-Encoding 是否接受 gzip
+
+  // 为 root 下不小于 minSize 的可压缩文件生成 .gz，已有且不比原文件旧的直接沿用
+  // 压缩后没有变小的文件不生成；返回新生成的文件数
+  size_t precompressTree(const std::string& root, size_t minSize);
+
+} // namespace Compression
+
+
+/*
+  每个 EventLoop 一个的 gzip 压缩器，只在所属 loop 线程中使用
+  z_stream 只初始化一次，每次压缩前 deflateReset，避免每个请求分配 deflate 的内部状态（约 256KB）
+  压缩结果缓存在一个小的 LRU 中：文件按 FileCache 条目的身份（设备、inode、大小、mtime）缓存，命中时不读文件也不计算校验和，
+  压缩后没有变小的文件同样记下（空结果）
+*/
+
+class GzipCompressor : noncopyable {
+ public:
+  typedef std::shared_ptr<const std::string> Output;
+
+  GzipCompressor(int level, size_t cacheCapacity);
+  ~GzipCompressor();
+
+  // 压缩后没有变小或出错时返回空，调用方应发送原始内容；未命中时先 pread 到内部的 scratch 中
+  Output compressFile(int fd, const struct stat& st);
+
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+ private:
+  static const size_t kChunkSize = 16 * 1024;
+  static const size_t kEntryOverhead = 64;  // 每个缓存条目另计的字节数，空结果的条目也占容量
+
+  struct Key {  // 与 ETag 相同的文件身份，mtime 精确到纳秒
+    uint64_t length;
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t mtime;
+    bool operator==(const Key& rhs) const {
+      return length == rhs.length && dev == rhs.dev && ino == rhs.ino && mtime == rhs.mtime;
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& k) const {
+      uint64_t h = k.length * 0x9E3779B97F4A7C15ULL;
+      for (uint64_t v : { k.dev, k.ino, k.mtime }) {
+        h = (h ^ v) * 0x100000001B3ULL;
+      }
+      return static_cast<size_t>(h);
+    }
+  };
+  typedef std::list<std::pair<Key, Output>> LruList;
+
+  Output lookup(const Key& key, bool* found);
+  Output deflateIfSmaller(const char* data, size_t len);  // 压缩后没有变小或出错时返回空
+  bool deflateAll(const char* data, size_t len, std::string* out);
+  void insert(const Key& key, const Output& output);
+
+  z_stream stream_;
+  bool initialized_;
+  std::vector<char> scratch_;
+
+  const size_t cacheCapacity_;
+  size_t cacheBytes_;
+  LruList lru_;
+  std::unordered_map<Key, LruList::iterator, KeyHash> index_;
+  size_t hits_;
+  size_t misses_;
+};
+
+
+#endif  // COMPRESSION_H
@@ -0,0 +1,164 @@
+#include "DiskIoPool.h"
+#include "base/EventLoop.h"
+#include "base/Logging.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+
+namespace
+{
+
+// 回调、holder 和读到的数据放在同一个对象中，回到 loop 的 functor 只有一个指针，放得进 InplaceFunction 的内联存储
+struct Completion {
+  DiskIoPool::ReadCallback cb;
+  std::shared_ptr<const void> holder;  // 随回调一起回到 loop 线程释放
+  std::string data;
+  size_t done;
+  int err;
+};
+
+struct RunCompletion {
+  std::unique_ptr<Completion> completion;
+  void operator()() const { completion->cb(completion->data.data(), completion->done, completion->err); }
+};
+
+} // namespace
+
+DiskIoPool::DiskIoPool(int numThreads)
+  : notEmpty_(mutex_),
+    running_(true),
+    inlineReads_(0),
+    offloadedReads_(0),
+    offloadedBytes_(0)
+{
+  for (int i = 0; i < numThreads; ++i) {
+    char name[32];
+    snprintf(name, sizeof(name), "DiskIo%d", i);
+    threads_.emplace_back(new Thread(std::bind(&DiskIoPool::threadFunc, this), name));
+    threads_.back()->start();
+  }
+}
+
+DiskIoPool::~DiskIoPool() {
+  {
+    MutexLockGuard lock(mutex_);
+    running_ = false;
+    queue_.clear();
+  }
+  notEmpty_.notifyAll();
+  for (const std::unique_ptr<Thread>& thread : threads_) {
+    thread->join();
+  }
+  LOG_INFO << "DiskIoPool: " << stats();
+}
+
+size_t DiskIoPool::readNoWait(int fd, char* buf, size_t len, off_t offset, bool* wouldBlock) {
+  size_t done = 0;
+  *wouldBlock = false;
+  while (done < len) {
+    struct iovec iov = { buf + done, len - done };
+    ssize_t n = ::preadv2(fd, &iov, 1, offset + static_cast<off_t>(done), RWF_NOWAIT);
+    if (n > 0) {
+      done += static_cast<size_t>(n);
+    }
+    else if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    else {
+      // EAGAIN 表示剩下的页不在 page cache 中；文件系统不支持 RWF_NOWAIT 时（EOPNOTSUPP）同样交给 IO 线程
+      *wouldBlock = n < 0 && (errno == EAGAIN || errno == EOPNOTSUPP);
+      break;
+    }
+  }
+  if (done == len) {
+    ++inlineReads_;
+  }
+  return done;
+}
+
+// 只探测少数几个字节，部分驻留的文件可能漏判，这时 sendfile 仍会在 loop 线程中等待没读到的页
+bool DiskIoPool::resident(int fd, off_t offset, size_t len) {
+  if (len == 0) {
+    return true;
+  }
+  for (int i = 0; i < kResidencyProbes; ++i) {  // 第一个和最后一个字节都在探测之列
+    off_t pos = offset + static_cast<off_t>((len - 1) / (kResidencyProbes - 1) * i);
+    if (i == kResidencyProbes - 1) {
+      pos = offset + static_cast<off_t>(len - 1);
+    }
+    char c;
+    struct iovec iov = { &c, 1 };
+    ssize_t n;
+    do {
+      n = ::preadv2(fd, &iov, 1, pos, RWF_NOWAIT);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {  // EAGAIN；不支持 RWF_NOWAIT 时与 readNoWait 一样按冷数据处理
+      return false;
+    }
+  }
+  return true;
+}
+
+void DiskIoPool::submit(EventLoop* loop, int fd, off_t offset, size_t len,
+                        const std::shared_ptr<const void>& holder, ReadCallback cb) {
+  ++offloadedReads_;
+  offloadedBytes_ += len;
+  {
+    MutexLockGuard lock(mutex_);
+    queue_.push_back(Task{ loop, fd, offset, len, holder, std::move(cb) });
+  }
+  notEmpty_.notify();
+}
+
+void DiskIoPool::threadFunc() {
+  while (true) {
+    Task task;
+    {
+      MutexLockGuard lock(mutex_);
+      while (queue_.empty() && running_) {
+        notEmpty_.wait();
+      }
+      if (!running_) {
+        return;
+      }
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    std::unique_ptr<Completion> completion(new Completion{ std::move(task.cb), std::move(task.holder),
+                                                           std::string(task.len, '\0'), 0, 0 });
+    size_t& done = completion->done;
+    while (done < task.len) {
+      ssize_t n = ::pread(task.fd, &completion->data[done], task.len - done, task.offset + static_cast<off_t>(done));
+      if (n > 0) {
+        done += static_cast<size_t>(n);
+      }
+      else if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      else {
+        completion->err = n < 0 ? errno : 0;
+        break;
+      }
+    }
+    task.loop->queueInLoop(RunCompletion{ std::move(completion) });
+  }
+}
+
+std::string DiskIoPool::stats() const {
+  size_t inlineReads = inlineReads_, offloaded = offloadedReads_;
+  size_t reads = inlineReads + offloaded;
+  size_t queued;
+  {
+    MutexLockGuard lock(mutex_);
+    queued = queue_.size();
+  }
+  char buf[256];
+  snprintf(buf, sizeof(buf), "inline = %zu, offloaded = %zu (%zu bytes), offload rate = %.3f, queued = %zu",
+           inlineReads, offloaded, static_cast<size_t>(offloadedBytes_),
+           reads == 0 ? 0.0 : static_cast<double>(offloaded) / reads, queued);
+  return buf;
+}
@@ -0,0 +1,76 @@
+#ifndef DISKIOPOOL_H
+#define DISKIOPOOL_H
+
+#include "base/noncopyable.h"
+#include "base/Mutex.h"
+#include "base/Condition.h"
+#include "base/Thread.h"
+
+#include <sys/types.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EventLoop;
+
+
+/*
+  磁盘读线程池，所有 EventLoop 共享
+  loop 线程先用 readNoWait()（preadv2 + RWF_NOWAIT）读，数据都在 page cache 中时直接完成，不经过线程池；
+  遇到需要等待磁盘的部分再 submit() 给 IO 线程阻塞读取，完成后经 EventLoop::queueInLoop 回到发起的 loop 中回调，
+  缺页和磁盘 IO 只阻塞 IO 线程，不会拖住同一 loop 上的其他连接
+  sendfile 无法不阻塞地执行，发送大文件前先用 resident() 抽查，冷文件改为分块读，同样由 IO 线程读取
+*/
+
+class DiskIoPool : noncopyable {
+ public:
+  // 在发起 submit() 的 loop 线程中调用，n 为读到的字节数，err 为 pread 失败时的 errno
+  typedef std::function<void (const char* data, size_t n, int err)> ReadCallback;
+
+  explicit DiskIoPool(int numThreads);
+  ~DiskIoPool();  // 丢弃未开始的请求，等待所有线程退出
+
+  // 不阻塞地读 [offset, offset + len)，返回读到的字节数；需要等待磁盘时 *wouldBlock 为 true
+  size_t readNoWait(int fd, char* buf, size_t len, off_t offset, bool* wouldBlock);
+  // 抽查 [offset, offset + len) 中均匀分布的 kResidencyProbes 个字节是否都在 page cache 中，不会等待磁盘
+  bool resident(int fd, off_t offset, size_t len);
+  // holder 在回调之前一直持有，保证 fd 有效
+  // 线程池不持有 loop：回调执行前 loop 必须一直存在（HttpServer 中各 EventLoop 与进程同生命周期）
+  void submit(EventLoop* loop, int fd, off_t offset, size_t len,
+              const std::shared_ptr<const void>& holder, ReadCallback cb);
+
+  size_t inlineReads() const { return inlineReads_; }
+  size_t offloadedReads() const { return offloadedReads_; }
+  size_t offloadedBytes() const { return offloadedBytes_; }
+  std::string stats() const;
+
+ private:
+  static const int kResidencyProbes = 8;
+
+  struct Task {
+    EventLoop* loop;
+    int fd;
+    off_t offset;
+    size_t len;
+    std::shared_ptr<const void> holder;
+    ReadCallback cb;
+  };
+
+  void threadFunc();
+
+  mutable MutexLock mutex_;
+  Condition notEmpty_;
+  std::deque<Task> queue_;
+  bool running_;
+  std::vector<std::unique_ptr<Thread>> threads_;
+
+  std::atomic<size_t> inlineReads_;     // readNoWait 全部命中 page cache
+  std::atomic<size_t> offloadedReads_;  // 交给 IO 线程
+  std::atomic<size_t> offloadedBytes_;
+};
+
+
+#endif  // DISKIOPOOL_H
@@ -0,0 +1,201 @@
+#include "FileCache.h"
+#include "HttpConnection.h"
+#include "HttpHeaders.h"
+#include "base/EventLoop.h"
+#include "base/Logging.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+
+namespace
+{
+
+const uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE
+                          | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+} // namespace
+
+
+FileCache::Entry::~Entry() {
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+FileCache::FileCache(EventLoop* loop, const std::string& root, size_t maxEntries)
+  : loop_(loop),
+    root_(root),
+    maxEntries_(maxEntries),
+    inotifyFd_(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+    hits_(0),
+    misses_(0),
+    invalidations_(0)
+{
+  if (inotifyFd_ < 0) {  // 无法感知文件变化时不缓存，每次都重新 stat
+    LOG_SYSERR << "FileCache::FileCache(), inotify_init1, cache disabled";
+    return;
+  }
+  inotifyChannel_.reset(new Channel(loop_, inotifyFd_));
+  inotifyChannel_->setReadCallback(std::bind(&FileCache::handleRead, this));
+  inotifyChannel_->enableReading();
+  watchTree("");
+}
+
+FileCache::~FileCache() {
+  LOG_INFO << "FileCache of loop " << loop_ << ": hits = " << hits_ << ", misses = " << misses_
+           << ", invalidations = " << invalidations_ << ", entries = " << entries_.size();
+  if (inotifyChannel_) {
+    inotifyChannel_->disableAll();
+    inotifyChannel_->remove();
+    ::close(inotifyFd_);
+  }
+}
+
+FileCache::EntryPtr FileCache::lookup(boost::string_view path) {
+  loop_->assertInLoopThread();
+  auto it = entries_.find(path);
+  if (it != entries_.end()) {
+    ++hits_;
+    return it->second;
+  }
+
+  ++misses_;
+  EntryPtr entry = load(path);
+  bool openFailed = entry->isRegular() && (entry->st.st_mode & S_IROTH) && !entry->readable();
+  if (inotifyChannel_ && !openFailed) {  // EMFILE 之类的错误不缓存
+    if (entries_.size() >= maxEntries_) {  // 热点文件很少，只有大量不同的 404 路径才会到这里
+      clear();
+    }
+    entries_.emplace(boost::string_view(entry->path), entry);
+  }
+  return entry;
+}
+
+FileCache::EntryPtr FileCache::load(boost::string_view path) {
+  std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+  entry->path.assign(path.data(), path.size());
+  std::string realPath = root_ + entry->path;
+
+  if (::stat(realPath.c_str(), &entry->st) < 0) {
+    entry->err = errno;
+    return entry;
+  }
+  entry->mimeType = HttpConnection::mimeType(entry->path);
+  entry->compressible = HttpConnection::compressible(entry->path);
+  char date[HttpHeaders::kDateLength + 1];
+  HttpHeaders::formatDate(entry->st.st_mtim.tv_sec, date);
+  entry->lastModified.assign(date, HttpHeaders::kDateLength);
+  char etag[64];
+  int n = snprintf(etag, sizeof(etag), "\"%jx-%jx-%jx\"", static_cast<uintmax_t>(entry->st.st_ino),
+                   static_cast<uintmax_t>(entry->st.st_size),
+                   static_cast<uintmax_t>(entry->st.st_mtim.tv_sec) * 1000000000 + entry->st.st_mtim.tv_nsec);
+  entry->etag.assign(etag, n);
+  if (S_ISREG(entry->st.st_mode) && (entry->st.st_mode & S_IROTH)) {
+    entry->fd = ::open(realPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (entry->fd < 0) {
+      LOG_SYSERR << "FileCache::load(), open " << realPath;
+    }
+  }
+  return entry;
+}
+
+void FileCache::handleRead() {
+  alignas(struct inotify_event) char buf[4096];
+  while (true) {
+    ssize_t n = ::read(inotifyFd_, buf, sizeof(buf));
+    if (n <= 0) {
+      if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        LOG_SYSERR << "FileCache::handleRead()";
+      }
+      return;
+    }
+
+    for (char* p = buf; p < buf + n; ) {
+      const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(p);
+      p += sizeof(struct inotify_event) + ev->len;
+
+      if (ev->mask & IN_Q_OVERFLOW) {  // 丢失了事件，只能全部作废
+        changed(boost::string_view());
+        continue;
+      }
+      auto watch = watches_.find(ev->wd);
+      if (watch == watches_.end()) {
+        continue;
+      }
+      if (ev->mask & IN_IGNORED) {
+        watches_.erase(watch);
+        continue;
+      }
+      if (ev->len == 0) {  // 目录自身被删除或移走
+        changed(boost::string_view());
+        continue;
+      }
+
+      std::string path = watch->second + "/" + ev->name;
+      if (ev->mask & IN_ISDIR) {
+        // 目录变化会影响其下所有条目，包括缓存的 404，直接全部作废
+        changed(boost::string_view());
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+          watchTree(path);
+        }
+      }
+      else {
+        changed(path);
+      }
+    }
+  }
+}
+
+void FileCache::watchTree(const std::string& dir) {
+  std::string realDir = root_ + dir;
+  int wd = ::inotify_add_watch(inotifyFd_, realDir.c_str(), kWatchMask | IN_ONLYDIR);
+  if (wd < 0) {
+    LOG_SYSERR << "FileCache::watchTree(), inotify_add_watch " << realDir;
+    return;
+  }
+  watches_[wd] = dir;
+
+  DIR* d = ::opendir(realDir.c_str());
+  if (d == nullptr) {
+    return;
+  }
+  while (struct dirent* e = ::readdir(d)) {
+    if (e->d_type == DT_DIR && strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0) {
+      watchTree(dir + "/" + e->d_name);
+    }
+  }
+  ::closedir(d);
+}
+
+void FileCache::changed(boost::string_view path) {
+  if (path.empty()) {
+    clear();
+  }
+  else {
+    invalidate(path);
+  }
+  if (invalidateCallback_) {
+    invalidateCallback_(path);
+  }
+}
+
+void FileCache::invalidate(boost::string_view path) {
+  auto it = entries_.find(path);
+  if (it != entries_.end()) {
+    LOG_DEBUG << "FileCache::invalidate(): " << path;
+    ++invalidations_;
+    entries_.erase(it);
+  }
+}
+
+void FileCache::clear() {
+  invalidations_ += entries_.size();
+  entries_.clear();
+}
@@ -0,0 +1,95 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include "base/noncopyable.h"
+#include "base/Channel.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <boost/utility/string_view.hpp>
+
+class EventLoop;
+
+
+/*
+  静态资源的元数据缓存，每个 EventLoop 一个，只在所属 loop 线程中使用，无需加锁
+  key 为相对 root 的规范化路径（如 "/css/style.css"），缓存 stat 结果、已打开的只读 fd 和 MIME 类型，
+  不存在的文件同样缓存（负缓存），命中时不产生任何系统调用
+  通过 inotify 监视 root 下所有目录，文件被修改/删除/新建时使对应条目失效，无需重启即可看到修改
+  Entry 用 shared_ptr 管理，条目失效后正在使用它的请求仍可安全读取，最后一个引用释放时关闭 fd
+*/
+
+class FileCache : noncopyable {
+ public:
+  struct Entry : noncopyable {
+    Entry() : err(0), fd(-1), mimeType(nullptr), compressible(false) {}
+    ~Entry();
+
+    bool exists() const { return err == 0; }
+    bool isRegular() const { return exists() && S_ISREG(st.st_mode); }
+    bool readable() const { return fd >= 0; }  // 其他用户可读的普通文件才会打开
+
+    std::string path;      // map 中的 key 指向这里
+    int err;               // stat 失败时的 errno
+    int fd;
+    struct stat st;
+    const char* mimeType;
+    bool compressible;         // 按扩展名判断是否值得 gzip，见 HttpConnection::compressible()
+    std::string lastModified;  // st_mtime 的 HTTP-date，用于 Last-Modified 和 If-Range
+    std::string etag;          // 由 inode、大小和 mtime 生成的强 ETag，带引号
+  };
+  typedef std::shared_ptr<const Entry> EntryPtr;
+  typedef std::function<void (boost::string_view path)> InvalidateCallback;  // path 为空表示全部失效
+
+  struct PathHash {
+    size_t operator()(boost::string_view s) const {  // FNV-1a
+      size_t h = 14695981039346656037ULL;
+      for (char c : s) {
+        h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+      }
+      return h;
+    }
+  };
+
+  static const size_t kDefaultMaxEntries = 4096;
+
+  FileCache(EventLoop* loop, const std::string& root, size_t maxEntries = kDefaultMaxEntries);
+  ~FileCache();
+
+  EntryPtr lookup(boost::string_view path);  // path 必须已规范化，总是返回非空
+  // 条目因 inotify 事件失效时回调，用于同步清理依赖文件内容的其他缓存
+  void setInvalidateCallback(InvalidateCallback cb) { invalidateCallback_ = std::move(cb); }
+
+  size_t size() const { return entries_.size(); }
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+  size_t invalidations() const { return invalidations_; }
+
+ private:
+  EntryPtr load(boost::string_view path);
+  void handleRead();
+  void watchTree(const std::string& dir);  // dir 相对 root，"" 表示 root 本身
+  void changed(boost::string_view path);  // 文件变化，path 为空表示全部
+  void invalidate(boost::string_view path);
+  void clear();
+
+  EventLoop* loop_;
+  const std::string root_;
+  const size_t maxEntries_;
+  std::unordered_map<boost::string_view, EntryPtr, PathHash> entries_;
+  InvalidateCallback invalidateCallback_;
+
+  int inotifyFd_;
+  std::unique_ptr<Channel> inotifyChannel_;
+  std::unordered_map<int, std::string> watches_;  // watch descriptor -> 相对 root 的目录
+
+  size_t hits_;
+  size_t misses_;
+  size_t invalidations_;
+};
+
+
+#endif  // FILECACHE_H
@@ -0,0 +1,250 @@
+#include "HttpBody.h"
+#include "HttpConfig.h"
+#include "base/Buffer.h"
+#include "base/Logging.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+namespace
+{
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// 匿名临时文件，关闭后自动删除；文件系统不支持 O_TMPFILE 时退回 mkstemp + unlink
+int openSpillFile(const std::string& dir) {
+  int fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+  if (fd >= 0) {
+    return fd;
+  }
+  std::string path = dir + "/httpbody-XXXXXX";
+  fd = ::mkostemp(&path[0], O_CLOEXEC);
+  if (fd >= 0) {
+    ::unlink(path.c_str());
+  }
+  return fd;
+}
+
+} // namespace
+
+
+HttpBody::HttpBody(const HttpConfig& config)
+  : config_(config),
+    chunked_(false),
+    chunkState_(kChunkSize),
+    remaining_(0),
+    received_(0),
+    charged_(0),
+    spillFd_(-1)
+  {}
+
+HttpBody::~HttpBody() {
+  reset();
+}
+
+void HttpBody::startLength(size_t length) {
+  chunked_ = false;
+  remaining_ = length;
+}
+
+void HttpBody::startChunked() {
+  chunked_ = true;
+  chunkState_ = kChunkSize;
+  remaining_ = 0;
+}
+
+void HttpBody::reset() {
+  chunked_ = false;
+  chunkState_ = kChunkSize;
+  remaining_ = 0;
+  received_ = 0;
+  dataCallback_ = DataCallback();
+
+  releaseMemory();
+  if (memory_.capacity() > kKeepCapacity) {
+    std::string().swap(memory_);
+  }
+  if (spillFd_ >= 0) {
+    ::close(spillFd_);
+    spillFd_ = -1;
+  }
+}
+
+HttpBody::Result HttpBody::consume(Buffer* buf) {
+  if (chunked_) {
+    return consumeChunked(buf);
+  }
+
+  size_t n = std::min(remaining_, buf->readableBytes());
+  if (n > 0) {
+    Result ret = deliver(buf->beginRead(), n);
+    if (ret != kNeedMore) {
+      return ret;
+    }
+    buf->retrieve(n);
+    remaining_ -= n;
+  }
+  return remaining_ == 0 ? kDone : kNeedMore;
+}
+
+// chunk = chunk-size [ chunk-ext ] CRLF chunk-data CRLF，以 size 为 0 的 chunk 和 trailer 结束
+HttpBody::Result HttpBody::consumeChunked(Buffer* buf) {
+  while (true) {
+    switch (chunkState_) {
+      case kChunkSize: {
+        const char* crlf = buf->findCrlf();
+        if (crlf == nullptr) {
+          if (buf->readableBytes() > kMaxChunkLine) {
+            LOG_DEBUG << "HttpBody::consumeChunked(): chunk size line too long";
+            return kError;
+          }
+          return kNeedMore;
+        }
+        size_t size = 0;
+        const char* p = buf->beginRead();
+        for (; p < crlf && hexValue(*p) >= 0; ++p) {
+          if (size > (SIZE_MAX >> 4)) {
+            LOG_DEBUG << "HttpBody::consumeChunked(): chunk size overflow";
+            return kError;
+          }
+          size = size * 16 + hexValue(*p);
+        }
+        if (p == buf->beginRead() || (p < crlf && *p != ';' && *p != ' ' && *p != '\t')) {
+          LOG_DEBUG << "HttpBody::consumeChunked(): bad chunk size";
+          return kError;
+        }
+        buf->retrieveUntil(crlf + 2);  // 忽略 chunk-ext
+        remaining_ = size;
+        chunkState_ = size == 0 ? kTrailer : kChunkData;
+        break;
+      }
+
+      case kChunkData: {
+        size_t n = std::min(remaining_, buf->readableBytes());
+        if (n == 0) {
+          return kNeedMore;
+        }
+        Result ret = deliver(buf->beginRead(), n);
+        if (ret != kNeedMore) {
+          return ret;
+        }
+        buf->retrieve(n);
+        remaining_ -= n;
+        if (remaining_ == 0) {
+          chunkState_ = kChunkDataEnd;
+        }
+        break;
+      }
+
+      case kChunkDataEnd:
+        if (buf->readableBytes() < 2) {
+          return kNeedMore;
+        }
+        if (buf->beginRead()[0] != '\r' || buf->beginRead()[1] != '\n') {
+          LOG_DEBUG << "HttpBody::consumeChunked(): missing CRLF after chunk data";
+          return kError;
+        }
+        buf->retrieve(2);
+        chunkState_ = kChunkSize;
+        break;
+
+      case kTrailer: {  // trailer 中的首部不使用，直接丢弃
+        const char* crlf = buf->findCrlf();
+        if (crlf == nullptr) {
+          if (buf->readableBytes() > kMaxChunkLine) {
+            LOG_DEBUG << "HttpBody::consumeChunked(): trailer line too long";
+            return kError;
+          }
+          return kNeedMore;
+        }
+        bool last = crlf == buf->beginRead();
+        buf->retrieveUntil(crlf + 2);
+        if (last) {
+          chunkState_ = kFinished;
+        }
+        break;
+      }
+
+      case kFinished:
+        return kDone;
+    }
+  }
+}
+
+HttpBody::Result HttpBody::deliver(const char* data, size_t len) {
+  if (len > config_.maxBodySize - received_) {
+    LOG_DEBUG << "HttpBody::deliver(): body too large";
+    return kTooLarge;
+  }
+  received_ += len;
+
+  bool ok = dataCallback_ ? dataCallback_(data, len) : store(data, len);
+  return ok ? kNeedMore : kError;
+}
+
+bool HttpBody::store(const char* data, size_t len) {
+  if (spillFd_ < 0) {
+    if (memory_.size() + len <= config_.bodySpillThreshold) {
+      // 预算不足时也不拒绝请求，而是转存到磁盘
+      size_t used = config_.inflightBodyMemory.fetch_add(len, std::memory_order_relaxed) + len;
+      if (used <= config_.maxInflightBodyMemory) {
+        charged_ += len;
+        memory_.append(data, len);
+        return true;
+      }
+      config_.inflightBodyMemory.fetch_sub(len, std::memory_order_relaxed);
+    }
+    if (!spill()) {
+      return false;
+    }
+  }
+  return writeSpill(data, len);
+}
+
+bool HttpBody::spill() {
+  assert(spillFd_ < 0);
+  spillFd_ = openSpillFile(config_.spillDir);
+  if (spillFd_ < 0) {
+    LOG_SYSERR << "HttpBody::spill(), open temp file in " << config_.spillDir;
+    return false;
+  }
+  LOG_DEBUG << "HttpBody::spill(): " << memory_.size() << " bytes moved to temp file";
+
+  bool ok = writeSpill(memory_.data(), memory_.size());
+  releaseMemory();
+  return ok;
+}
+
+bool HttpBody::writeSpill(const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::write(spillFd_, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG_SYSERR << "HttpBody::writeSpill(), write temp file";
+      return false;
+    }
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+void HttpBody::releaseMemory() {
+  if (charged_ > 0) {
+    config_.inflightBodyMemory.fetch_sub(charged_, std::memory_order_relaxed);
+    charged_ = 0;
+  }
+  memory_.clear();
+}
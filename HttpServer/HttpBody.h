@@ -0,0 +1,81 @@
+#ifndef HTTPBODY_H
+#define HTTPBODY_H
+
+#include "base/noncopyable.h"
+
+#include <functional>
+#include <string>
+#include <boost/utility/string_view.hpp>
+
+class Buffer;
+struct HttpConfig;
+
+
+/*
+  流式接收请求体：每次读事件调用 consume()，按 Content-Length 或 chunked 编码解出数据后立即从 input buffer 中 retrieve，
+  input buffer 不会因为请求体而无限增长
+  解出的数据交给 DataCallback（若设置），否则由 HttpBody 自己保存：
+  不超过 bodySpillThreshold 且全局预算允许时放在内存中，否则转存到 spillDir 下的匿名临时文件
+  内存中的字节计入 HttpConfig::inflightBodyMemory，reset()/析构时归还
+*/
+
+class HttpBody : noncopyable {
+ public:
+  enum Result {
+    kNeedMore,
+    kDone,
+    kError,     // 编码错误或临时文件写入失败
+    kTooLarge,  // 超过 maxBodySize
+  };
+
+  // 返回 false 表示中止接收，consume() 返回 kError
+  typedef std::function<bool (const char* data, size_t len)> DataCallback;
+
+  explicit HttpBody(const HttpConfig& config);
+  ~HttpBody();
+
+  void startLength(size_t length);
+  void startChunked();
+  void setDataCallback(DataCallback cb) { dataCallback_ = std::move(cb); }  // 在 start*() 之后设置，reset() 时清除
+
+  Result consume(Buffer* buf);
+  void reset();
+
+  size_t size() const { return received_; }  // 已解码的字节数
+  bool spilled() const { return spillFd_ >= 0; }
+  int spillFd() const { return spillFd_; }
+  boost::string_view data() const { return boost::string_view(memory_); }  // 未转存时的完整内容
+
+ private:
+  enum ChunkState {
+    kChunkSize,
+    kChunkData,
+    kChunkDataEnd,  // 数据后的 CRLF
+    kTrailer,
+    kFinished,
+  };
+
+  static const size_t kMaxChunkLine = 1024;  // chunk-size 行及 trailer 行的长度上限
+  static const size_t kKeepCapacity = 4096;  // reset() 后 memory_ 最多保留的容量
+
+  Result consumeChunked(Buffer* buf);
+  Result deliver(const char* data, size_t len);
+  bool store(const char* data, size_t len);
+  bool spill();
+  bool writeSpill(const char* data, size_t len);
+  void releaseMemory();
+
+  const HttpConfig& config_;
+  bool chunked_;
+  ChunkState chunkState_;
+  size_t remaining_;  // Content-Length 剩余字节数，或当前 chunk 剩余字节数
+  size_t received_;
+  DataCallback dataCallback_;
+
+  std::string memory_;
+  size_t charged_;  // 已计入 inflightBodyMemory 的字节数
+  int spillFd_;
+};
+
+
+#endif  // HTTPBODY_H
@@ -0,0 +1,70 @@
+#ifndef HTTPCONFIG_H
+#define HTTPCONFIG_H
+
+#include "base/noncopyable.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ResponseCache;
+class DiskIoPool;
+
+
+/*
+  一个 HttpServer 的配置及全局状态，所有 loop 的 HttpConnectionPool 共享同一份
+  由 main() 创建并通过 HttpConnectionPool::initLoop 传给各个 loop，字段在 server.start() 后不再修改
+*/
+
+struct HttpConfig : noncopyable {
+  std::string sourceDir = "./resources";
+  size_t sendfileThreshold = 16 * 1024;                 // 不小于该大小的文件用 sendfile 发送，更小的拷贝进 Buffer 与响应头一起发送
+  bool sendfile = true;                                 // 关闭时大文件改为分块 pread，每发完一块在 WriteCompleteCallback 中读下一块
+                                                        // 打开时抽查到不在 page cache 中的大文件同样分块发送，由 diskIoPool 读取
+  size_t streamChunkSize = 64 * 1024;
+  size_t outputHighWaterMark = 1024 * 1024;             // 连接上积压的响应超过该值时暂停读取和处理后续请求，直到全部发出
+  bool precompress = true;                              // 启动时为可压缩的静态文件生成 .gz
+  size_t precompressMinSize = 1024;                     // 太小的文件压缩收益不抵额外的首部
+
+  // 静态资源的 Cache-Control: max-age，按 path 的最长前缀匹配，都不匹配时用 defaultMaxAge
+  // maxAge 为 0 时发送 no-cache（每次用 ETag 校验），小于 0 时不发送
+  struct CachePolicy {
+    std::string prefix;
+    int maxAge;
+  };
+  std::vector<CachePolicy> cachePolicies = {
+    {"/css/",    7 * 24 * 3600},
+    {"/js/",     7 * 24 * 3600},
+    {"/images/", 7 * 24 * 3600},
+    {"/fonts/",  30 * 24 * 3600},
+  };
+  int defaultMaxAge = 0;
+
+  // 没有 .gz 的可压缩响应在发送前动态压缩
+  bool gzip = true;
+  int gzipLevel = 6;
+  size_t gzipMinSize = 1024;
+  size_t gzipMaxSize = 1024 * 1024;                     // 更大的文件直接 sendfile，不占用 loop 线程压缩
+  size_t gzipCacheCapacity = 4 * 1024 * 1024;           // 每个 loop 缓存的压缩结果总字节数
+
+  // 热点文件的完整响应缓存，为空时不缓存
+  std::shared_ptr<ResponseCache> responseCache;
+  size_t responseCacheCapacity = 64 * 1024 * 1024;
+  size_t responseCacheMaxObjectSize = 256 * 1024;       // 只缓存不超过该大小的文件
+
+  // 不在 page cache 中的文件由 IO 线程读取，避免缺页阻塞 loop；为空时在 loop 线程中直接 pread
+  std::shared_ptr<DiskIoPool> diskIoPool;
+  int diskIoThreads = 4;
+
+  // 请求体
+  std::string spillDir = "/tmp";                        // 大请求体写入此目录下的匿名临时文件
+  size_t bodySpillThreshold = 64 * 1024;                // 单个请求体在内存中超过该大小后转存到临时文件，表单解码结果超过时返回 413
+  size_t maxBodySize = 1024 * 1024 * 1024;              // 单个请求体上限，超出返回 413
+  size_t maxInflightBodyMemory = 64 * 1024 * 1024;      // 所有连接缓存在内存中的请求体总量上限，超出后直接写临时文件
+
+  mutable std::atomic<size_t> inflightBodyMemory{0};    // 当前缓存在内存中的请求体字节数
+};
+
+
+#endif  // HTTPCONFIG_H
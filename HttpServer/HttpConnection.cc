@@ -1,13 +1,22 @@
 #include "HttpConnection.h"
+#include "HttpConnectionPool.h"
+#include "HttpConfig.h"
+#include "ResponseCache.h"
+#include "Compression.h"
+#include "DiskIoPool.h"
 #include "base/TcpConnection.h"
 #include "base/Buffer.h"
 #include "base/Timestamp.h"
 #include "base/Logging.h"
 #include "base/EventLoop.h"
 
-#include <regex>
-#include <sys/mman.h>
-#include <fcntl.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <boost/any.hpp>
 
 
@@ -21,13 +30,16 @@ void timeoutCallback(std::weak_ptr<TcpConnection> tiedConn) {
 
 void onConnection(const TcpConnectionPtr& conn) {
   if (conn->connected()) {
-    HttpConnectionPtr httpData(new HttpConnection("./resources"));
+    HttpConnection* httpData = HttpConnectionPool::of(conn->getLoop())->acquire();
     httpData->setTimerId(conn->getLoop()->runAfter(std::bind(timeoutCallback, conn), 60));
     conn->setContext(httpData);
+    conn->setHighWaterMarkCallback(onHighWaterMark, httpData->outputHighWaterMark());
   }
   else {  // timeoutCallback 会忽略已经关闭的 TcpConnection，这里不移除会造成 conn 延迟析构，高并发时会有过多文件被打开导致 core dump
-    HttpConnectionPtr httpData = boost::any_cast<HttpConnectionPtr>(conn->getContext());
+    HttpConnection* httpData = boost::any_cast<HttpConnection*>(conn->getContext());
     conn->getLoop()->cancel(httpData->getTimerId());
+    conn->setContext(boost::any());
+    HttpConnectionPool::of(conn->getLoop())->release(httpData);
     LOG_DEBUG << conn->name() << " is down";
   }
 }
@@ -35,21 +47,60 @@ void onConnection(const TcpConnectionPtr& conn) {
 void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp t) {
   // LOG_DEBUG << "read buf:\n" << std::string(buf->beginRead(), buf->readableBytes());
 
-  HttpConnectionPtr httpData = boost::any_cast<HttpConnectionPtr>(conn->getContext());
+  HttpConnection* httpData = boost::any_cast<HttpConnection*>(conn->getContext());
   conn->getLoop()->cancel(httpData->getTimerId());
   httpData->setTimerId(conn->getLoop()->runAfter(std::bind(timeoutCallback, conn), 60));
   httpData->processMessage(conn, buf, t);
 }
 
+// 以下回调经 queueInLoop 执行，此时连接可能已经断开，HttpConnection 已归还对象池
+void onHighWaterMark(const TcpConnectionPtr& conn, size_t bytes) {
+  if (!conn->getContext().empty()) {
+    LOG_DEBUG << conn->name() << " high water mark " << bytes;
+    boost::any_cast<HttpConnection*>(conn->getContext())->onHighWaterMark(conn);
+  }
+}
+
+void onDiskRead(const std::weak_ptr<TcpConnection>& tiedConn, size_t expected, const char* data, size_t n, int err) {
+  TcpConnectionPtr conn = tiedConn.lock();
+  if (conn && conn->connected() && !conn->getContext().empty()) {
+    boost::any_cast<HttpConnection*>(conn->getContext())->onDiskRead(conn, data, n, expected, err);
+  }
+}
+
+void onWriteComplete(const TcpConnectionPtr& conn) {
+  if (!conn->getContext().empty()) {
+    HttpConnection* httpData = boost::any_cast<HttpConnection*>(conn->getContext());
+    conn->getLoop()->cancel(httpData->getTimerId());  // 慢客户端只要还在接收就不超时
+    httpData->setTimerId(conn->getLoop()->runAfter(std::bind(timeoutCallback, conn), 60));
+    httpData->onWriteComplete(conn);
+  }
+}
 
-const std::map<int, std::string> HttpConnection::kResponses = {
-  {200, "OK"},
-  {400, "Bad Request"},
-  {403, "Forbidden"},
-  {404, "Not Found"},
+
+const char* HttpConnection::statusText(int code) {
+  switch (code) {
+    case 200: return "OK";
+    case 206: return "Partial Content";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 413: return "Payload Too Large";
+    case 416: return "Range Not Satisfiable";
+    default:  return nullptr;
+  }
+}
+
+namespace
+{
+
+struct MimeType {
+  boost::string_view suffix;
+  const char* type;
 };
 
-const std::map<std::string, std::string> HttpConnection::kMimeType = {
+const MimeType kMimeTypes[] = {
   {".html",   "text/html"},
   {".xml",    "text/xml"},
   {".xhtml",  "application/xhtml+xml"},
@@ -69,100 +120,358 @@ const std::map<std::string, std::string> HttpConnection::kMimeType = {
   {".tar",    "application/x-tar"},
   {".css",    "text/css"},
   {".js",     "text/javascript"},
+  {".json",   "application/json"},
+  {".svg",    "image/svg+xml"},
+  {".ico",    "image/x-icon"},
+  {".ttf",    "font/ttf"},
+  {".otf",    "font/otf"},
+  {".woff",   "font/woff"},
+  {".woff2",  "font/woff2"},
+  {".eot",    "application/vnd.ms-fontobject"},
 };
 
-// const std::map<std::string, bool> HttpConnection::kPostUserVerify = {
-//   {"/register.html", false},
-//   {"/login.html",    true},
-// };
+size_t preadFull(int fd, char* buf, size_t length, off_t offset) {
+  size_t done = 0;
+  while (done < length) {
+    ssize_t n = ::pread(fd, buf + done, length - done, offset + static_cast<off_t>(done));
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return done;
+}
+
+int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool parseOffset(boost::string_view s, off_t* value) {
+  if (s.empty()) {
+    return false;
+  }
+  off_t n = 0;
+  for (char c : s) {
+    if (c < '0' || c > '9' || n > (INT64_MAX - 9) / 10) {
+      return false;
+    }
+    n = n * 10 + (c - '0');
+  }
+  *value = n;
+  return true;
+}
+
+boost::string_view trimSpace(boost::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+std::atomic<uint64_t> gBoundarySeq(0);
+
+// 不在 kMimeTypes 中时返回 nullptr
+const char* findMimeType(boost::string_view path) {
+  size_t pos = path.find_last_of('.');
+  if (pos != boost::string_view::npos) {
+    boost::string_view suffix = path.substr(pos);
+    for (const MimeType& m : kMimeTypes) {
+      if (m.suffix == suffix) {
+        return m.type;
+      }
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
 
-HttpConnection::HttpConnection(const std::string& sourceDir)
-  : parseState_(kRequestLine),
+const char* HttpConnection::mimeType(boost::string_view path) {
+  const char* type = findMimeType(path);
+  return type != nullptr ? type : "text/plain";
+}
+
+// 未知扩展名的文件可能是任意二进制数据（已压缩的归档、媒体等），压缩只会浪费 CPU
+bool HttpConnection::compressible(boost::string_view path) {
+  const char* type = findMimeType(path);
+  return Compression::compressibleType(type != nullptr ? type : "application/octet-stream");
+}
+
+HttpConnection::HttpConnection(const HttpConfig& config, FileCache* fileCache, GzipCompressor* compressor,
+                               BufferPool* bufferPool)
+  : parseState_(kHeader),
+    path_(ArenaAllocator<char>(&arena_)),
+    hasBody_(false),
+    body_(config),
+    postBuf_(bufferPool),
+    numPost_(0),
+    fieldBegin_(0),
+    valueBegin_(std::string::npos),
+    hexDigits_(0),
+    hexByte_(0),
+    formError_(kNoRequest),
     responseCode_(-1),
     keepAlive_(false),
-    kSourceDir(sourceDir)
+    acceptGzip_(false),
+    vary_(false),
+    numRanges_(0),
+    completeLength_(0),
+    responseBuf_(bufferPool),
+    streamTail_(bufferPool),
+    streamBuf_(bufferPool),
+    paused_(false),
+    reading_(false),
+    closeAfterSend_(false),
+    config_(config),
+    fileCache_(fileCache),
+    compressor_(compressor)
   {}
 
 void HttpConnection::processMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
-  HttpCode parseRet = parseRequest(buf);
-  if (parseRet == kNoRequest) {
+  if (paused_) {  // 前面的响应还没发完，请求留在 buf 中，恢复后再处理
     return;
   }
 
-  makeResponse(conn->outputBuffer(), parseRet);
-  conn->send(conn->outputBuffer());
-  if (!keepAlive_) {
+  // 响应按顺序攒到 responseBuf_ 中，最后一次性发送
+  closeAfterSend_ = handleMessage(buf, &responseBuf_, conn.get());
+  if (!streams_.empty() || (!closeAfterSend_ && backlog(&responseBuf_, conn.get()) >= config_.outputHighWaterMark)) {
+    pause(conn);  // 先注册回调再 send，send 可能立即写完
+  }
+  if (responseBuf_.readableBytes() > 0) {
+    conn->send(std::move(responseBuf_));  // 直接从 responseBuf_ 写出，没写完的部分交换存储进 TcpConnection，不拷贝
+  }
+  responseBuf_.release();
+  if (!streams_.empty()) {
+    sendChunk(conn);
+  }
+  else if (closeAfterSend_) {
     conn->shutdown();
   }
+}
+
+size_t HttpConnection::outputHighWaterMark() const {
+  return config_.outputHighWaterMark;
+}
+
+size_t HttpConnection::memoryUsage() const {
+  return sizeof(*this) + arena_.reservedBytes() + postBuf_.internalCapacity() + responseBuf_.internalCapacity()
+         + streamTail_.internalCapacity() + streamBuf_.internalCapacity();
+}
+
+// 已生成还未发出的响应，共享发送的数据已经交给了 TcpConnection
+size_t HttpConnection::backlog(const Buffer* outputBuf, const TcpConnection* conn) const {
+  return outputBuf->readableBytes() + conn->outputChain().memoryBytes();
+}
+
+void HttpConnection::pause(const TcpConnectionPtr& conn) {
+  if (!paused_) {
+    paused_ = true;
+    conn->stopRead();
+    conn->setWriteCompleteCallback(::onWriteComplete);
+  }
+}
+
+// 之前的响应积压在 TcpConnection 中，客户端接收太慢
+void HttpConnection::onHighWaterMark(const TcpConnectionPtr& conn) {
+  pause(conn);
+}
+
+void HttpConnection::onWriteComplete(const TcpConnectionPtr& conn) {
+  if (!paused_) {
+    return;
+  }
+  if (!streams_.empty()) {
+    sendChunk(conn);
+    return;
+  }
+
+  paused_ = false;
+  conn->setWriteCompleteCallback(WriteCompleteCallback());
+  if (closeAfterSend_) {
+    conn->shutdown();
+    return;
+  }
+  conn->startRead();
+  processMessage(conn, conn->inputBuffer(), Timestamp::now());
+}
+
+// 有 DiskIoPool 且 wouldBlock 非空时不阻塞，数据不在 page cache 中则读到一部分就返回
+size_t HttpConnection::readFile(int fd, char* buf, size_t length, off_t offset, bool* wouldBlock) {
+  if (wouldBlock != nullptr && config_.diskIoPool) {
+    return config_.diskIoPool->readNoWait(fd, buf, length, offset, wouldBlock);
+  }
+  return preadFull(fd, buf, length, offset);
+}
+
+void HttpConnection::queueRegion(Buffer* outputBuf, TcpConnection* conn, const FileCache::EntryPtr& file,
+                                 off_t offset, size_t length) {
+  if (streams_.empty()) {
+    conn->send(outputBuf);
+  }
   else {
-    resetState();
+    holdTail(outputBuf);
   }
+  streams_.push_back(StreamRegion{ file, offset, length, 0 });
 }
 
-HttpConnection::HttpCode HttpConnection::parseRequest(Buffer* inputBuf) {
-  while (parseState_ != kFinish) {
-    const char* crlf = inputBuf->findCrlf();  // pos or nullptr
-    std::string line;
-    if (parseState_ == kBody) {  // FIXME: 由 Content-Length 读取 body，认为 body 没有结尾标识符 CRLF
-      assert(header_.find("Content-Length") != header_.end());
-      size_t remain = std::stoul(header_["Content-Length"]) - body_.size();
-      if (inputBuf->readableBytes() < remain) {
-        return kNoRequest;
+// 每次只读一块，发完后由 onWriteComplete 继续，连接上积压的文件数据不超过一块
+// 不在 page cache 中的部分交给 DiskIoPool，读完后在 onDiskRead 中发送
+void HttpConnection::sendChunk(const TcpConnectionPtr& conn) {
+  if (reading_) {
+    return;
+  }
+  StreamRegion& region = streams_.front();
+  size_t length = std::min(region.length, config_.streamChunkSize);
+  streamBuf_.ensureWritableBytes(length);
+  bool wouldBlock = false;
+  size_t n = readFile(region.file->fd, streamBuf_.beginWrite(), length, region.offset, &wouldBlock);
+  streamBuf_.hasWritten(n);
+  region.offset += static_cast<off_t>(n);
+  region.length -= n;
+
+  if (wouldBlock) {
+    reading_ = true;
+    config_.diskIoPool->submit(conn->getLoop(), region.file->fd, region.offset, length - n, region.file,
+                               std::bind(::onDiskRead, std::weak_ptr<TcpConnection>(conn), length - n,
+                                         std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    return;
+  }
+  if (n != length) {
+    LOG_SYSERR << "HttpConnection::sendChunk(), pread " << region.file->path;
+    abortStream(conn);
+    return;
+  }
+  finishChunk(conn);
+}
+
+void HttpConnection::onDiskRead(const TcpConnectionPtr& conn, const char* data, size_t n, size_t expected, int err) {
+  assert(reading_ && !streams_.empty());
+  reading_ = false;
+  if (n != expected) {
+    errno = err;
+    LOG_SYSERR << "HttpConnection::onDiskRead(), pread " << streams_.front().file->path;
+    abortStream(conn);
+    return;
+  }
+  streamBuf_.append(data, n);
+  streams_.front().offset += static_cast<off_t>(n);
+  streams_.front().length -= n;
+  finishChunk(conn);
+}
+
+// 文件在缓存后被截断或读取出错，已发出的 Content-Length 无法兑现，只能关闭连接
+void HttpConnection::abortStream(const TcpConnectionPtr& conn) {
+  streams_.clear();
+  streamTail_.retrieveAll();
+  streamBuf_.retrieveAll();
+  closeAfterSend_ = true;
+  conn->shutdown();
+}
+
+void HttpConnection::finishChunk(const TcpConnectionPtr& conn) {
+  StreamRegion& region = streams_.front();
+  if (region.length == 0) {
+    streamBuf_.append(streamTail_.beginRead(), region.tail);
+    streamTail_.retrieve(region.tail);
+    streamTail_.release();
+    streams_.erase(streams_.begin());
+  }
+  conn->send(std::move(streamBuf_));
+  streamBuf_.release();
+}
+
+void HttpConnection::holdTail(Buffer* outputBuf) {
+  size_t n = outputBuf->readableBytes();
+  streamTail_.append(outputBuf->beginRead(), n);
+  streams_.back().tail += n;
+  outputBuf->retrieveAll();
+}
+
+bool HttpConnection::handleMessage(Buffer* inputBuf, Buffer* outputBuf, TcpConnection* conn) {
+  // 依次处理 inputBuf 中所有完整的请求（pipelining）
+  while (true) {
+    HttpCode parseRet = parseRequest(inputBuf, outputBuf);
+    if (parseRet == kNoRequest) {
+      return false;
+    }
+
+    makeResponse(outputBuf, parseRet, conn);
+    if (!streams_.empty()) {  // 响应的剩余部分要等分块发送的文件发完
+      holdTail(outputBuf);
+    }
+    if (parseState_ == kFinish) {
+      if (!hasBody_) {  // 有请求体时首部和请求体都已经取走
+        inputBuf->retrieve(parser_.headerLength());
       }
-      line += inputBuf->retrieveAsString(remain);
     }
-    else if (crlf == nullptr) {  // FIXME: 没考虑\r和\n单独出现的情况
-      LOG_DEBUG << "HttpConnection::parse(): no CRLF in message";
-      return kNoRequest;
+    else {  // 请求格式错误或在请求体到达前被拒绝，无法确定请求边界，丢弃剩余数据并关闭连接
+      inputBuf->retrieveAll();
     }
-    else {
-      line += inputBuf->retrieveAsString(static_cast<size_t>(crlf - inputBuf->beginRead()));
-      inputBuf->retrieveUntil(crlf+2);
+
+    if (!keepAlive_) {
+      return true;
     }
+    resetState();
 
-    HttpCode ret = kNoRequest;
-    switch (parseState_) {
-      case kRequestLine:
-        ret = parseRequestLine(line);
-        if (ret != kNoRequest) {
-          return ret;
-        }
-        break;
+    if (conn != nullptr && (!streams_.empty() || backlog(outputBuf, conn) >= config_.outputHighWaterMark)) {
+      return false;  // 已生成的响应发出后再处理后续请求，由 processMessage 暂停
+    }
+  }
+}
 
-      case kHeader:
-        ret = parseRequestHeader(line);
-        if (ret != kNoRequest) {
-          return ret;
-        }
-        break;
+HttpConnection::HttpCode HttpConnection::parseRequest(Buffer* inputBuf, Buffer* outputBuf) {
+  if (parseState_ == kHeader) {
+    HttpParser::Result result = parser_.parse(inputBuf);
+    if (result == HttpParser::kIncomplete) {
+      return kNoRequest;
+    }
+    else if (result == HttpParser::kError) {
+      LOG_DEBUG << "HttpConnection::parseRequest(): bad request";
+      return kBadRequest;
+    }
 
-      case kBody:
-        ret = parseRequestBody(line);
-        if (ret != kNoRequest) {
-          return ret;
-        }
-        break;
+    HttpCode ret = parseRequestHeader(inputBuf, outputBuf);
+    if (ret != kNoRequest) {
+      return ret;
+    }
+  }
 
-      default:
-        break;
-    }  // switch
-  }  // while
+  if (parseState_ == kBody) {
+    HttpBody::Result result = body_.consume(inputBuf);
+    if (result == HttpBody::kNeedMore) {
+      return kNoRequest;
+    }
+    else if (result == HttpBody::kError) {
+      return formError_ != kNoRequest ? formError_ : kBadRequest;
+    }
+    else if (result == HttpBody::kTooLarge) {
+      return kTooLarge;
+    }
+    parseState_ = kFinish;
+  }
 
-  assert(parseState_ == kFinish);  // 似乎unreachable
+  assert(parseState_ == kFinish);
+  HttpCode ret = parseRequestBody();
+  if (ret != kNoRequest) {
+    return ret;
+  }
   return kGetRequest;
 }
 
-HttpConnection::HttpCode HttpConnection::parseRequestLine(const std::string& line) {
-  std::regex pattern("^([^ ]+) ([^ ]+) HTTP/([^ ]+)$");
-  std::smatch result;
-  if (!std::regex_match(line, result, pattern)) {
-    LOG_DEBUG << "HttpConnection::parseRequestLine(): bad request line";
+HttpConnection::HttpCode HttpConnection::parseRequestLine() {
+  if (!normalizePath(parser_.path(), &path_)) {
+    LOG_DEBUG << "HttpConnection::parseRequestLine(): bad path";
     return kBadRequest;
   }
-  method_ = result[1];
-  path_ = result[2];
-  version_ = result[3];
-  parseState_ = kHeader;
 
   if (path_ == "/") {
     path_ += "index.html";
@@ -171,55 +480,245 @@ HttpConnection::HttpCode HttpConnection::parseRequestLine(const std::string& lin
     path_ += ".html";
   }
 
-  if (::stat((kSourceDir+path_).c_str(), &requestFileStat_) < 0 
-      || S_ISDIR(requestFileStat_.st_mode)) {
+  acceptGzip_ = Compression::acceptsGzip(parser_.header(HttpHeaders::kAcceptEncoding));
+  if (config_.responseCache && !hasBody_ && parser_.method() == "GET"
+      && parser_.header(HttpHeaders::kRange).empty() && parser_.header(HttpHeaders::kIfNoneMatch).empty()
+      && parser_.header(HttpHeaders::kIfModifiedSince).empty()) {
+    cachedResponse_ = config_.responseCache->get(path_, cacheVariant());
+    if (cachedResponse_) {
+      return kNoRequest;
+    }
+  }
+
+  file_ = fileCache_->lookup(path_);
+  if (!file_->exists() || S_ISDIR(file_->st.st_mode)) {
     LOG_DEBUG << "HttpConnection::parseRequestLine(): no resource";
     return kNoResource;
   }
 
-  if (!(requestFileStat_.st_mode & S_IROTH)) {
+  if (!(file_->st.st_mode & S_IROTH)) {
     LOG_DEBUG << "HttpConnection::parseRequestLine(): no permission";
     return kForbidden;
   }
 
-  return kNoRequest;
+  if (!file_->readable()) {  // 非普通文件，或 open 失败
+    LOG_DEBUG << "HttpConnection::parseRequestLine(): not a readable file";
+    return kNoResource;
+  }
+
+  selectEncoding();
+  return parseRange();
+}
+
+// 可压缩的类型都带 Vary；客户端接受 gzip 且存在不比原文件旧的 .gz 时改为发送它
+void HttpConnection::selectEncoding() {
+  gzipFile_.reset();
+  vary_ = file_->compressible;
+  if (!vary_ || !acceptGzip_) {
+    return;
+  }
+
+  ArenaString gzPath(path_);
+  gzPath += ".gz";
+  FileCache::EntryPtr gz = fileCache_->lookup(gzPath);
+  const struct timespec& gzTime = gz->st.st_mtim;
+  const struct timespec& time = file_->st.st_mtim;
+  if (gz->readable() && (gzTime.tv_sec > time.tv_sec
+                         || (gzTime.tv_sec == time.tv_sec && gzTime.tv_nsec >= time.tv_nsec))) {
+    gzipFile_ = std::move(gz);
+  }
 }
 
-HttpConnection::HttpCode HttpConnection::parseRequestHeader(const std::string& line) {
-  if (line.size() == 0) { // header末尾的CRLF
-    if (header_.find("Content-Length") == header_.end()
-        || (stoi(header_.at("Content-Length"))) == 0) {
-      parseState_ = kFinish;
-      return kGetRequest;
+// 只处理 GET 的 bytes 范围，语法错误、范围过多或 If-Range 不匹配时忽略 Range，返回完整文件
+// 所有范围都超出文件末尾时返回 416；重叠或相邻的范围排序后合并
+HttpConnection::HttpCode HttpConnection::parseRange() {
+  boost::string_view range = parser_.header(HttpHeaders::kRange);
+  const boost::string_view kUnit("bytes=");
+  if (range.empty() || parser_.method() != "GET" || range.size() < kUnit.size()
+      || !HttpHeaders::equalsIgnoreCase(range.substr(0, kUnit.size()), kUnit) || !ifRangeMatches()) {
+    return kNoRequest;
+  }
+  range.remove_prefix(kUnit.size());
+
+  const off_t size = file_->st.st_size;
+  size_t n = 0;
+  bool valid = false;  // 至少有一个语法正确的范围
+  while (!range.empty()) {
+    size_t comma = range.find(',');
+    boost::string_view spec = trimSpace(range.substr(0, comma));
+    range.remove_prefix(comma == boost::string_view::npos ? range.size() : comma + 1);
+    if (spec.empty()) {  // 列表允许空元素
+      continue;
     }
-    else {
-      parseState_ = kBody;
+
+    size_t dash = spec.find('-');
+    if (dash == boost::string_view::npos) {
       return kNoRequest;
     }
+    boost::string_view firstPos = spec.substr(0, dash), lastPos = spec.substr(dash + 1);
+    off_t first, last;
+    if (firstPos.empty()) {  // "-N"：最后 N 字节
+      off_t suffix;
+      if (!parseOffset(lastPos, &suffix)) {
+        return kNoRequest;
+      }
+      first = suffix < size ? size - suffix : 0;
+      last = suffix > 0 ? size - 1 : -1;
+    }
+    else {
+      if (!parseOffset(firstPos, &first)) {
+        return kNoRequest;
+      }
+      if (lastPos.empty()) {
+        last = size - 1;
+      }
+      else if (!parseOffset(lastPos, &last) || last < first) {
+        return kNoRequest;
+      }
+      last = std::min(last, size - 1);
+    }
+    valid = true;
+
+    if (first <= last) {  // 否则不可满足，跳过
+      if (n == kMaxRanges) {
+        return kNoRequest;
+      }
+      ranges_[n++] = ByteRange{ first, last };
+    }
   }
 
-  std::regex pattern("^([^:]+): *(.+)$");
-  std::smatch result;
-  if (!std::regex_match(line, result, pattern)) {
-    LOG_DEBUG << "HttpConnection::parseHeader(): bad header";
-    return kBadRequest;
+  completeLength_ = size;
+  if (n == 0) {
+    return valid ? kRangeNotSatisfiable : kNoRequest;
   }
-  header_[result[1]] = result[2];
+
+  std::sort(ranges_, ranges_ + n, [](const ByteRange& lhs, const ByteRange& rhs) { return lhs.first < rhs.first; });
+  numRanges_ = 1;
+  for (size_t i = 1; i < n; ++i) {
+    ByteRange& back = ranges_[numRanges_ - 1];
+    if (ranges_[i].first <= back.last + 1) {
+      back.last = std::max(back.last, ranges_[i].last);
+    }
+    else {
+      ranges_[numRanges_++] = ranges_[i];
+    }
+  }
+  if (numRanges_ > 1) {
+    snprintf(boundary_, sizeof(boundary_), "%020" PRIu64, ++gBoundarySeq);
+  }
+  gzipFile_.reset();  // 范围针对未压缩的文件
   return kNoRequest;
 }
 
-HttpConnection::HttpCode HttpConnection::parseRequestBody(const std::string& line) {
-  body_ += line;
-  size_t contentLength = stoul(header_.at("Content-Length"));
-  if (body_.size() < contentLength) {
-    return kNoRequest;
+// If-Range 只做强比较：实体标签必须与未压缩文件的 ETag 相同，日期必须与 Last-Modified 完全相同
+bool HttpConnection::ifRangeMatches() const {
+  boost::string_view ifRange = parser_.header(HttpHeaders::kIfRange);
+  if (ifRange.empty()) {
+    return true;
+  }
+  if (ifRange.front() == '"' || ifRange.starts_with("W/")) {
+    return ifRange == file_->etag;
   }
-  else if (body_.size() > contentLength) {
-    LOG_DEBUG << "HttpConnection::parseBody(): body too long";
+  time_t t;
+  return HttpHeaders::parseDate(ifRange, &t) && t == file_->st.st_mtim.tv_sec;
+}
+
+// 去掉 query/fragment，消去空段、"." 和 ".."，越过根目录的路径视为非法
+bool HttpConnection::normalizePath(boost::string_view target, ArenaString* out) {
+  target = target.substr(0, target.find_first_of("?#"));
+  if (target.empty() || target[0] != '/') {
+    return false;
+  }
+
+  out->clear();
+  while (!target.empty()) {
+    size_t slash = target.find('/');
+    boost::string_view segment = target.substr(0, slash);
+    target.remove_prefix(slash == boost::string_view::npos ? target.size() : slash + 1);
+
+    if (segment.empty() || segment == ".") {
+      continue;
+    }
+    if (segment == "..") {
+      if (out->empty()) {
+        return false;
+      }
+      out->resize(out->rfind('/'));
+      continue;
+    }
+    *out += '/';
+    out->append(segment.data(), segment.size());
+  }
+
+  if (out->empty()) {
+    *out += '/';
+  }
+  return true;
+}
+
+HttpConnection::HttpCode HttpConnection::parseRequestHeader(Buffer* inputBuf, Buffer* outputBuf) {
+  boost::string_view length = parser_.header(HttpHeaders::kContentLength);
+  size_t contentLength = 0;
+  for (char c : length) {
+    if (c < '0' || c > '9' || contentLength > (SIZE_MAX - 9) / 10) {
+      LOG_DEBUG << "HttpConnection::parseRequestHeader(): bad Content-Length";
+      return kBadRequest;
+    }
+    contentLength = contentLength * 10 + (c - '0');
+  }
+
+  boost::string_view encoding = parser_.header(HttpHeaders::kTransferEncoding);
+  bool chunked = !encoding.empty();
+  if (chunked && (!length.empty() || !HttpHeaders::equalsIgnoreCase(encoding, "chunked"))) {
+    // 同时带 Content-Length 可能是请求走私，其他传输编码不支持
+    LOG_DEBUG << "HttpConnection::parseRequestHeader(): unsupported Transfer-Encoding";
     return kBadRequest;
   }
+  if (contentLength > config_.maxBodySize) {
+    LOG_DEBUG << "HttpConnection::parseRequestHeader(): Content-Length too large";
+    return kTooLarge;
+  }
 
-  if (method_ == "POST") {
+  hasBody_ = chunked || contentLength > 0;
+  parseState_ = hasBody_ ? kBody : kFinish;
+
+  // 在接收请求体之前检查资源，被拒绝的请求不必等待客户端上传
+  HttpCode ret = parseRequestLine();
+  if (ret != kNoRequest || !hasBody_) {
+    return ret;
+  }
+
+  // 请求体到达后就从 input buffer 中取走，首部需要先拷贝出来
+  size_t n = parser_.headerLength();
+  char* header = static_cast<char*>(arena_.allocate(n, 1));
+  memcpy(header, inputBuf->beginRead(), n);
+  parser_.rebase(header);
+  inputBuf->retrieve(n);
+
+  if (chunked) {
+    body_.startChunked();
+  }
+  else {
+    body_.startLength(contentLength);
+  }
+  if (parser_.method() == "POST"
+      && parser_.header(HttpHeaders::kContentType) == "application/x-www-form-urlencoded") {
+    // 表单直接解码到 postBuf_，不经过 body_ 的内存缓存和临时文件；长度已知时一次借到足够的存储
+    if (!chunked) {
+      postBuf_.ensureWritableBytes(std::min(contentLength, config_.bodySpillThreshold));
+    }
+    body_.setDataCallback([this](const char* data, size_t len) { return decodeForm(data, len); });
+  }
+
+  if (parser_.version() == "1.1"
+      && HttpHeaders::equalsIgnoreCase(parser_.header(HttpHeaders::kExpect), "100-continue")) {
+    outputBuf->append("HTTP/1.1 100 Continue\r\n\r\n");
+  }
+  return kNoRequest;
+}
+
+HttpConnection::HttpCode HttpConnection::parseRequestBody() {
+  if (parser_.method() == "POST") {
     HttpCode ret = parsePost();
     if (ret != kNoRequest) {
       return ret;
@@ -229,9 +728,7 @@ HttpConnection::HttpCode HttpConnection::parseRequestBody(const std::string& lin
       return ret;
     }
   }
-
-  parseState_ = kFinish;
-  return kGetRequest;
+  return kNoRequest;
 }
 
 HttpConnection::HttpCode HttpConnection::parsePost() {
@@ -240,72 +737,119 @@ HttpConnection::HttpCode HttpConnection::parsePost() {
     return kNoRequest;
   }
 
-  if (header_.find("Content-Type") == header_.end()) {
+  boost::string_view contentType = parser_.header(HttpHeaders::kContentType);
+  if (contentType.empty()) {
     LOG_DEBUG << "HttpConnection::parsePost(): unknown Content-Type";
     return kBadRequest;
   }
 
-  if (header_["Content-Type"] == "application/x-www-form-urlencoded") {
-    return parseFromUrlEncode();
+  if (contentType == "application/x-www-form-urlencoded") {
+    return finishForm();
   }
   // else (other encode type)
 
   return kNoRequest;
 }
 
-HttpConnection::HttpCode HttpConnection::parseFromUrlEncode() {
-  std::string key, value;
-  std::string* current = &key;
-  size_t n = body_.size();
-  for (size_t i = 0; i < n; ++i) {
-    switch (body_[i]) {
+// 解码的数据追加到 postBuf_，字段边界记录在 post_ 中；解码结果超过 bodySpillThreshold 时以 413 拒绝，表单不转存到磁盘
+bool HttpConnection::decodeForm(const char* data, size_t len) {
+  for (const char* end = data + len; data < end; ++data) {
+    if (postBuf_.readableBytes() >= config_.bodySpillThreshold) {
+      LOG_DEBUG << "HttpConnection::decodeForm(): form too large";
+      formError_ = kTooLarge;
+      return false;
+    }
+
+    char c = *data;
+    if (hexDigits_ > 0) {
+      int v = hexValue(c);
+      if (v < 0) {
+        LOG_DEBUG << "HttpConnection::decodeForm(): wrong hex encode";
+        formError_ = kBadRequest;
+        return false;
+      }
+      hexByte_ = hexByte_ * 16 + v;
+      if (--hexDigits_ == 0) {
+        char byte = static_cast<char>(hexByte_);
+        postBuf_.append(&byte, 1);
+      }
+      continue;
+    }
+
+    switch (c) {
       case '=':
-        current = &value;
+        if (valueBegin_ == std::string::npos) {
+          valueBegin_ = postBuf_.readableBytes();
+        }
+        else {
+          postBuf_.append(&c, 1);
+        }
         break;
 
       case '&':
-        if (key.size() == 0 || value.size() == 0) {
-          LOG_DEBUG << "HttpConnection::parseFromUrlEncode(): empty key or value";
-          return kBadRequest;
+        if (!endFormField()) {
+          return false;
         }
-        post_[key] = value;
-        key.clear();
-        value.clear();
-        current = &key;
         break;
 
       case '+':
-        *current += ' ';
+        postBuf_.append(" ", 1);
         break;
 
       case '%':
-        if (i+2 >= n) {
-          LOG_DEBUG << "HttpConnection::parseFromUrlEncode(): wrong hex encode";
-          return kBadRequest;
-        }
-        *current += std::to_string(static_cast<int>(
-          strtol(body_.substr(i+1, 2).c_str(), nullptr, 16)
-          ));
-        i += 2;
+        hexDigits_ = 2;
+        hexByte_ = 0;
         break;
 
       default:
-        *current += body_[i];  
+        postBuf_.append(&c, 1);
         break;
     }
   }
+  return true;
+}
+
+bool HttpConnection::endFormField() {
+  if (valueBegin_ == std::string::npos || valueBegin_ == fieldBegin_ || valueBegin_ == postBuf_.readableBytes()) {
+    LOG_DEBUG << "HttpConnection::endFormField(): empty key or value";
+    formError_ = kBadRequest;
+    return false;
+  }
+  if (numPost_ == kMaxPostFields) {
+    LOG_DEBUG << "HttpConnection::endFormField(): too many fields";
+    formError_ = kBadRequest;
+    return false;
+  }
+  post_[numPost_].keyBegin = fieldBegin_;
+  post_[numPost_].valueBegin = valueBegin_;
+  post_[numPost_].end = postBuf_.readableBytes();
+  ++numPost_;
+  fieldBegin_ = postBuf_.readableBytes();
+  valueBegin_ = std::string::npos;
+  return true;
+}
 
-  if (key.size() == 0 || value.size() == 0) {
-    LOG_DEBUG << "HttpConnection::parseFromUrlEncode(): empty key or value";
+// 请求体接收完后结束最后一个字段
+HttpConnection::HttpCode HttpConnection::finishForm() {
+  if (hexDigits_ > 0) {
+    LOG_DEBUG << "HttpConnection::finishForm(): wrong hex encode";
     return kBadRequest;
   }
-  post_[key] = value;
+  if (!endFormField()) {
+    return formError_;
+  }
 
-  std::string log = "get POST [";
-  for (const auto& item : post_) {
-    log += item.first + ": " + item.second + ", ";
+  if (Logger::logLevel() <= Logger::INFO) {
+    Logger logger(__FILE__, __LINE__, Logger::INFO);
+    logger.stream() << "get POST [";
+    for (size_t i = 0; i < numPost_; ++i) {
+      const FormField& field = post_[i];
+      logger.stream() << boost::string_view(postBuf_.beginRead() + field.keyBegin, field.valueBegin - field.keyBegin)
+                      << ": " << boost::string_view(postBuf_.beginRead() + field.valueBegin, field.end - field.valueBegin)
+                      << ", ";
+    }
+    logger.stream() << "]";
   }
-  LOG_INFO << log << "]";
   return kNoRequest;
 }
 
@@ -321,25 +865,114 @@ HttpConnection::HttpCode HttpConnection::userVerify() {
     path_ = "/error.html";
   }
 
-  if (::stat((kSourceDir+path_).c_str(), &requestFileStat_) < 0) {
+  file_ = fileCache_->lookup(path_);
+  gzipFile_.reset();
+  if (!file_->readable()) {
     LOG_DEBUG << "HttpConnection::userVerify(): file no exist";
     return kNoResource;
   }
   return kNoRequest;
 }
 
-void HttpConnection::makeResponse(Buffer* outputBuf, HttpCode parseRet) {
+void HttpConnection::makeResponse(Buffer* outputBuf, HttpCode parseRet, TcpConnection* conn) {
   assert(parseRet != kNoRequest);
+  if (cachedResponse_ && parseRet == kGetRequest) {
+    responseCode_ = 200;
+    keepAlive_ = wantKeepAlive();
+    appendShared(outputBuf, conn, cachedResponse_, false);
+    return;
+  }
+
   initResponse(parseRet);
+  vary_ = file_->compressible;  // 错误页面和 POST 结果已替换 file_
+  compressBody();  // ETag 取决于实际发送的表示，比较校验器之前先确定是否压缩
+  if ((responseCode_ == 200 || responseCode_ == 206) && parser_.method() == "GET" && notModified()) {
+    responseCode_ = 304;
+  }
+
+  // 小文件的 GET 响应整体放入 ResponseCache，此时文件内容必须拷贝进 outputBuf
+  size_t bodySize = contentLength();
+  bool cacheable = responseCode_ == 200 && config_.responseCache && !hasBody_
+                   && parser_.method() == "GET" && config_.responseCache->admit(bodySize);
+  size_t begin = outputBuf->readableBytes();
   makeResponseLine(outputBuf);
   makeResponseHeader(outputBuf);
-  makeResponseBody(outputBuf);
+  if (makeResponseBody(outputBuf, conn, cacheable) && cacheable && streams_.empty()) {
+    config_.responseCache->put(path_, cacheVariant(), std::make_shared<const std::string>(
+        outputBuf->beginRead() + begin, outputBuf->readableBytes() - begin));
+  }
+}
+
+bool HttpConnection::willCompress() const {
+  size_t size = static_cast<size_t>(file_->st.st_size);
+  return config_.gzip && compressor_ != nullptr && acceptGzip_ && !gzipFile_ && vary_ && numRanges_ == 0
+         && size >= config_.gzipMinSize && size <= config_.gzipMaxSize;
+}
+
+// 没有预压缩文件时在发送前压缩，GzipCompressor 按文件身份缓存结果，同一版本的文件只读取和压缩一次
+// 304 也要先确定表示：缓存命中时只是一次查表，未命中时压缩一次，之后的请求都能命中
+void HttpConnection::compressBody() {
+  compressedBody_.reset();
+  if (willCompress()) {
+    compressedBody_ = compressor_->compressFile(file_->fd, file_->st);
+  }
+}
+
+// If-None-Match 存在时忽略 If-Modified-Since；实体标签做弱比较，晚于当前时间的日期无效
+bool HttpConnection::notModified() const {
+  boost::string_view ifNoneMatch = parser_.header(HttpHeaders::kIfNoneMatch);
+  if (!ifNoneMatch.empty()) {
+    if (trimSpace(ifNoneMatch) == "*") {
+      return true;
+    }
+    char buf[80];
+    int n = formatETag(buf, sizeof(buf));
+    boost::string_view etag(buf, n);
+    while (!ifNoneMatch.empty()) {
+      size_t comma = ifNoneMatch.find(',');
+      boost::string_view tag = trimSpace(ifNoneMatch.substr(0, comma));
+      ifNoneMatch.remove_prefix(comma == boost::string_view::npos ? ifNoneMatch.size() : comma + 1);
+      if (tag.starts_with("W/")) {
+        tag.remove_prefix(2);
+      }
+      if (tag == etag) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  time_t since;
+  boost::string_view ifModifiedSince = parser_.header(HttpHeaders::kIfModifiedSince);
+  return !ifModifiedSince.empty() && HttpHeaders::parseDate(ifModifiedSince, &since)
+         && since <= ::time(nullptr) && bodyFile().st.st_mtim.tv_sec <= since;
+}
+
+int HttpConnection::formatETag(char* buf, size_t len) const {
+  const std::string& etag = bodyFile().etag;
+  if (!compressedBody_) {  // 压缩后没有变小时发送的是原文件，校验器也用原文件的
+    return snprintf(buf, len, "%s", etag.c_str());
+  }
+  // 压缩结果由文件内容决定，沿用文件的 ETag 再加上编码即可区分两种表示
+  return snprintf(buf, len, "%.*s-gzip\"", static_cast<int>(etag.size() - 1), etag.data());
+}
+
+int HttpConnection::maxAge() const {
+  int maxAge = config_.defaultMaxAge;
+  size_t matched = 0;
+  for (const HttpConfig::CachePolicy& policy : config_.cachePolicies) {
+    if (policy.prefix.size() > matched && boost::string_view(path_).starts_with(policy.prefix)) {
+      maxAge = policy.maxAge;
+      matched = policy.prefix.size();
+    }
+  }
+  return maxAge;
 }
 
 void HttpConnection::initResponse(HttpCode httpCode) {
   switch (httpCode) {
     case kGetRequest:
-      responseCode_ = 200;
+      responseCode_ = numRanges_ > 0 ? 206 : 200;
       break;
     case kBadRequest:
       responseCode_ = 400;
@@ -350,34 +983,42 @@ void HttpConnection::initResponse(HttpCode httpCode) {
     case kNoResource:
       responseCode_ = 404;
       break;
+    case kTooLarge:
+      responseCode_ = 413;
+      break;
+    case kRangeNotSatisfiable:
+      responseCode_ = 416;
+      break;
     default:
       responseCode_ = 400;
       break;
   }
 
   // 需要前面代码保证path_对应的文件存在，对存在的文件如果下面系统调用都崩溃那404也发不出来，故abort
-  if (responseCode_ != 200) {
-    path_ = "/" + std::to_string(responseCode_) + ".html";   //  "/40x.html"
-    if (::stat((kSourceDir+path_).c_str(), &requestFileStat_) < 0) {
-      LOG_SYSFATAL << "HttpConnection::initResponse(), stat error";
+  if (responseCode_ >= 400) {
+    char errorPage[16];
+    snprintf(errorPage, sizeof(errorPage), "/%d.html", responseCode_);   //  "/40x.html"
+    path_.assign(errorPage);
+    file_ = fileCache_->lookup(path_);
+    gzipFile_.reset();
+    if (!file_->readable()) {
+      LOG_FATAL << "HttpConnection::initResponse(), no error page " << path_;
     }
   }
 }
 
 void HttpConnection::makeResponseLine(Buffer* outputBuf) {
   assert(responseCode_ != -1);
-  assert(kResponses.find(responseCode_) != kResponses.end());
-  outputBuf->append("HTTP/1.1 " + 
-                    std::to_string(responseCode_) +
-                    " " + kResponses.at(responseCode_) + "\r\n");
+  assert(statusText(responseCode_) != nullptr);
+  char line[64];
+  int n = snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", responseCode_, statusText(responseCode_));
+  outputBuf->append(line, n);
 }
 
 void HttpConnection::makeResponseHeader(Buffer* outputBuf) {
   // 框架accept后对connfd设置的keep-alive是TCP选项，这里是HTTP选项
   outputBuf->append("Connection: ");
-  if (header_.find("Connection") != header_.end()
-      && header_["Connection"] == "keep-alive"
-      && version_ == "1.1") {
+  if (wantKeepAlive()) {
     keepAlive_ = true;
     outputBuf->append("keep-alive\r\n");
     outputBuf->append("Keep-Alive: max=6, timeout=120\r\n");
@@ -387,58 +1028,223 @@ void HttpConnection::makeResponseHeader(Buffer* outputBuf) {
     outputBuf->append("close\r\n");
   }
 
+  char line[96];
+  int n;
+  if ((responseCode_ == 200 || responseCode_ == 206 || responseCode_ == 304) && parser_.method() == "GET") {
+    n = formatETag(line, sizeof(line));
+    outputBuf->append("ETag: ");
+    outputBuf->append(line, n);
+    outputBuf->append("\r\nLast-Modified: ");
+    outputBuf->append(bodyFile().lastModified);
+    outputBuf->append("\r\n");
+
+    int age = maxAge();
+    if (age == 0) {
+      outputBuf->append("Cache-Control: no-cache\r\n");
+    }
+    else if (age > 0) {
+      n = snprintf(line, sizeof(line), "Cache-Control: max-age=%d\r\n", age);
+      outputBuf->append(line, n);
+    }
+  }
+  if (vary_) {
+    outputBuf->append("Vary: Accept-Encoding\r\n");
+  }
+  if (responseCode_ == 304) {  // 没有 body，也不发送描述 body 的首部
+    outputBuf->append("\r\n");
+    return;
+  }
+
   outputBuf->append("Content-Type: ");
-  size_t pos = path_.find_last_of('.');
-  if (pos == std::string::npos) {
-    outputBuf->append("text/plain\r\n");
+  if (responseCode_ == 206 && numRanges_ > 1) {
+    outputBuf->append("multipart/byteranges; boundary=");
+    outputBuf->append(boundary_);
   }
   else {
-    std::string suffix = path_.substr(pos);
-    if (kMimeType.find(suffix) == kMimeType.end()) {
-      outputBuf->append("text/plain\r\n");
-    }
-    else {
-      outputBuf->append(kMimeType.at(suffix) + "\r\n");
-    }
+    outputBuf->append(file_->mimeType);
+  }
+  outputBuf->append("\r\n");
+  if (gzipFile_ || compressedBody_) {
+    outputBuf->append("Content-Encoding: gzip\r\n");
+  }
+  else if ((responseCode_ == 200 || responseCode_ == 206) && parser_.method() == "GET") {
+    outputBuf->append("Accept-Ranges: bytes\r\n");
+  }
+  if (responseCode_ == 206 && numRanges_ == 1) {
+    n = snprintf(line, sizeof(line), "Content-Range: bytes %jd-%jd/%jd\r\n", static_cast<intmax_t>(ranges_[0].first),
+                 static_cast<intmax_t>(ranges_[0].last), static_cast<intmax_t>(completeLength_));
+    outputBuf->append(line, n);
+  }
+  else if (responseCode_ == 416) {
+    n = snprintf(line, sizeof(line), "Content-Range: bytes */%jd\r\n", static_cast<intmax_t>(completeLength_));
+    outputBuf->append(line, n);
   }
 
-  outputBuf->append("Content-Length: " + std::to_string(requestFileStat_.st_size) + "\r\n");
+  n = snprintf(line, sizeof(line), "Content-Length: %zu\r\n", contentLength());
+  outputBuf->append(line, n);
 
   outputBuf->append("\r\n");
 }
 
-void HttpConnection::makeResponseBody(Buffer* outputBuf) {
-  int fd = ::open((kSourceDir+path_).c_str(), O_RDONLY);
-  if (fd < 0) {  // 高并发时会导致打开过多文件 FIXME: 解决文件打开过多问题
-    // LOG_SYSFATAL << "HttpConnection::makeResponseBody(), open error";
-    LOG_SYSERR << "HttpConnection::makeResponseBody(), open error";
-    return;
+size_t HttpConnection::contentLength() const {
+  if (compressedBody_) {
+    return compressedBody_->size();
+  }
+  if (responseCode_ != 206) {
+    return static_cast<size_t>(bodyFile().st.st_size);
   }
 
-  void* mmapRet = ::mmap(nullptr, requestFileStat_.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-  if (mmapRet == MAP_FAILED) {
-    LOG_SYSFATAL << "HttpConnection::makeResponseBody(), mmap error";
+  size_t length = 0;
+  for (size_t i = 0; i < numRanges_; ++i) {
+    length += static_cast<size_t>(ranges_[i].last - ranges_[i].first + 1);
   }
-  if (::close(fd) < 0) {
-    LOG_SYSERR << "HttpConnection::makeResponseBody(), close error";
+  if (numRanges_ > 1) {
+    for (size_t i = 0; i < numRanges_; ++i) {
+      length += formatPartHeader(nullptr, 0, i);
+    }
+    length += 8 + strlen(boundary_);  // "\r\n--" boundary "--\r\n"
   }
+  return length;
+}
 
-  outputBuf->append(static_cast<const char*>(mmapRet), requestFileStat_.st_size);  // 是否会阻塞？  框架会先copy到mmapAddr，再从mmapAddr copy到buffer，再写入sockfd
-                                                          // 能否如writev一样直接从mmapAddr写入sockfd，或直接从物理内存移到buffer中？
-  if (::munmap(mmapRet, requestFileStat_.st_size) < 0) {
-    LOG_SYSERR << "HttpConnection::makeResponseBody(), munmap error";
+int HttpConnection::formatPartHeader(char* buf, size_t len, size_t i) const {
+  return snprintf(buf, len, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %jd-%jd/%jd\r\n\r\n",
+                  boundary_, file_->mimeType, static_cast<intmax_t>(ranges_[i].first),
+                  static_cast<intmax_t>(ranges_[i].last), static_cast<intmax_t>(completeLength_));
+}
+
+unsigned HttpConnection::cacheVariant() const {
+  return static_cast<unsigned>(wantKeepAlive()) | static_cast<unsigned>(acceptGzip_) << 1;
+}
+
+bool HttpConnection::wantKeepAlive() const {
+  return parseState_ == kFinish && responseCode_ != 400
+         && HttpHeaders::equalsIgnoreCase(parser_.header(HttpHeaders::kConnection), "keep-alive")
+         && parser_.version() == "1.1";
+}
+
+bool HttpConnection::makeResponseBody(Buffer* outputBuf, TcpConnection* conn, bool inlineBody) {
+  if (responseCode_ == 304) {
+    return true;
+  }
+  if (compressedBody_) {
+    appendShared(outputBuf, conn, compressedBody_, inlineBody);
+    return true;
+  }
+
+  const FileCache::EntryPtr& file = gzipFile_ ? gzipFile_ : file_;
+  if (responseCode_ != 206) {
+    return appendFile(outputBuf, conn, file, 0, static_cast<size_t>(file->st.st_size), inlineBody);
+  }
+  if (numRanges_ == 1) {
+    return appendFile(outputBuf, conn, file, ranges_[0].first,
+                      static_cast<size_t>(ranges_[0].last - ranges_[0].first + 1), inlineBody);
   }
+
+  for (size_t i = 0; i < numRanges_; ++i) {
+    char part[256];
+    int n = formatPartHeader(part, sizeof(part), i);
+    assert(n > 0 && static_cast<size_t>(n) < sizeof(part));
+    outputBuf->append(part, n);
+    if (!appendFile(outputBuf, conn, file, ranges_[i].first,
+                    static_cast<size_t>(ranges_[i].last - ranges_[i].first + 1), inlineBody)) {
+      return false;
+    }
+  }
+  outputBuf->append("\r\n--");
+  outputBuf->append(boundary_);
+  outputBuf->append("--\r\n");
+  return true;
+}
+
+// 把文件的 [offset, offset + length) 追加到响应中，读取失败返回 false
+bool HttpConnection::appendFile(Buffer* outputBuf, TcpConnection* conn, const FileCache::EntryPtr& file,
+                                off_t offset, size_t length, bool inlineBody) {
+  if (conn != nullptr && !inlineBody && length >= config_.sendfileThreshold) {
+    // 响应头（或 multipart 的分隔行）先行发出以保持顺序，文件条目一直持有到发送完成，fd 不会因缓存失效而关闭
+    // 前面还有排队的区间（如冷数据由磁盘 IO 线程读取）时只能排在它后面，否则会先于它写入 socket
+    // 冷文件的 sendfile 会在 loop 线程中等待磁盘，抽查到不在 page cache 中时和分块发送一样排队，由磁盘 IO 线程读取
+    if (config_.sendfile && streams_.empty()
+        && (!config_.diskIoPool || config_.diskIoPool->resident(file->fd, offset, length))) {
+      // 用 sendfile 直接从 page cache 写入 socket
+      conn->send(outputBuf);
+      conn->sendFile(file->fd, offset, length, file);
+    }
+    else {
+      queueRegion(outputBuf, conn, file, offset, length);
+    }
+    return true;
+  }
+
+  // 小文件直接读到 outputBuf 中，与响应头合并为一次 write
+  outputBuf->ensureWritableBytes(length);
+  bool wouldBlock = false;
+  size_t done = readFile(file->fd, outputBuf->beginWrite(), length, offset, conn != nullptr ? &wouldBlock : nullptr);
+  outputBuf->hasWritten(done);
+  if (wouldBlock) {  // 不在 page cache 中，剩下的部分和分块发送一样排队，由磁盘 IO 线程读取
+    queueRegion(outputBuf, conn, file, offset + static_cast<off_t>(done), length - done);
+    return true;
+  }
+  if (done != length) {  // 文件在缓存后被截断，已发出的 Content-Length 无法兑现，只能关闭连接
+    LOG_SYSERR << "HttpConnection::makeResponseBody(), pread " << path_;
+    keepAlive_ = false;
+    return false;
+  }
+  return true;
+}
+
+// 缓存的响应、压缩结果等只读数据由 TcpConnection 直接引用发送，多个连接共用一份，不再拷贝进 outputBuf
+// outputBuf 中已有的数据排在前面一起发出；有分块发送的文件排队时只能拷贝到它们之后
+void HttpConnection::appendShared(Buffer* outputBuf, TcpConnection* conn, const std::shared_ptr<const std::string>& blob,
+                                  bool inlineBody) {
+  if (conn != nullptr && !inlineBody && streams_.empty() && blob->size() >= OutputChain::kMinSharedSize) {
+    conn->send(blob, outputBuf);  // 与 outputBuf 中的数据由一次 writev 写出
+    return;
+  }
+  outputBuf->append(blob->data(), blob->size());
+}
+
+void HttpConnection::recycle() {
+  resetState();
+  responseBuf_.retrieveAll();
+  responseBuf_.release();
+  streams_.clear();
+  streamTail_.retrieveAll();
+  streamTail_.release();
+  streamBuf_.retrieveAll();
+  streamBuf_.release();
+  paused_ = false;
+  reading_ = false;
+  closeAfterSend_ = false;
+  keepAlive_ = false;
+  timerId_ = TimerId();
 }
 
 void HttpConnection::resetState() {
-  parseState_ = kRequestLine;
+  parseState_ = kHeader;
 
-  method_.clear();  // TODO: 是否有必要清空？
-  path_.clear();
-  version_.clear();
-  header_.clear();
-  body_.clear();
+  parser_.reset();
+  hasBody_ = false;
+  body_.reset();
+  numPost_ = 0;
+  fieldBegin_ = 0;
+  valueBegin_ = std::string::npos;
+  hexDigits_ = 0;
+  hexByte_ = 0;
+  formError_ = kNoRequest;
+  postBuf_.retrieveAll();
+  postBuf_.release();
+
+  // 先让字符串放弃 arena 中的存储，再整体回收
+  ArenaString(ArenaAllocator<char>(&arena_)).swap(path_);
+  arena_.reset();
 
   responseCode_ = -1;
-  memset(&requestFileStat_, 0, sizeof(requestFileStat_));
-}
\ No newline at end of file
+  file_.reset();
+  cachedResponse_.reset();
+  gzipFile_.reset();
+  compressedBody_.reset();
+  acceptGzip_ = false;
+  vary_ = false;
+  numRanges_ = 0;
+}
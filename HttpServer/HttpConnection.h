@@ -4,11 +4,17 @@
 #include "base/noncopyable.h"
 #include "base/Callbacks.h"
 #include "base/TimerQueue.h"
+#include "base/Buffer.h"
+#include "base/Arena.h"
+#include "HttpParser.h"
+#include "HttpBody.h"
+#include "FileCache.h"
+#include "ResponseCache.h"
+#include "Compression.h"
 
 #include <string>
-#include <map>
 #include <memory>
-#include <sys/stat.h>
+#include <vector>
 
 
 /*
@@ -16,14 +22,24 @@
   处理完成后将响应信息装入 TcpConnectionPtr 的 output buffer
   调用 TcpConnectionPtr::send
   先 send response 的前半部分, 然后再 send 请求的文件
+  支持 pipelining：一次读事件中的多个请求按顺序处理，响应合并为一次 send
+  请求体由 HttpBody 边到达边解码并从 input buffer 中取走，此前先把首部拷贝到 arena_ 中，
+  因此请求行/首部的 view 在整个请求期间都有效；Expect: 100-continue 在首部检查通过后才回复
+  GET 支持 Range/If-Range：单个范围返回 206 + Content-Range，多个范围合并重叠部分后以 multipart/byteranges 返回，
+  每个范围和整个文件一样按大小选择 sendfile 或 pread；范围请求总是发送未压缩的文件
+  GET 的文件响应带 ETag/Last-Modified/Cache-Control，If-None-Match 或 If-Modified-Since 满足时返回不带 body 的 304
+  背压：积压的响应超过 HttpConfig::outputHighWaterMark（同一批 pipelining 生成的，或 TcpConnection 的高水位回调）
+  或正在分块发送文件时暂停读取和处理后续请求，WriteCompleteCallback 中续读下一块或恢复，每个慢客户端占用的内存有上限
 */
 
+struct HttpConfig;
+class BufferPool;
+
 class HttpConnection : noncopyable {
  public:
   enum ParseState {
-    kRequestLine,
-    kHeader,
-    kBody,
+    kHeader,  // 请求行 + 首部，由 HttpParser 增量解析
+    kBody,    // 首部已拷贝到 arena_ 并从 input buffer 中取走，由 body_ 接收请求体
     kFinish,
   };
 
@@ -33,58 +49,151 @@ class HttpConnection : noncopyable {
     kBadRequest,  // 格式错误
     kForbidden,
     kNoResource,
+    kTooLarge,  // 请求体超过 HttpConfig::maxBodySize 或表单过大
+    kRangeNotSatisfiable,
   };
 
-  static const std::map<int, std::string> kResponses;
-  static const std::map<std::string, std::string> kMimeType;
-  // static const std::map<std::string, bool> kPostUserVerify;
+  static const size_t kMaxPostFields = 16;
+  static const size_t kMaxRanges = 16;  // 合并前超过这个数目时忽略 Range，返回完整文件
+
+  static const char* statusText(int code);  // 不支持的状态码返回 nullptr
+  static const char* mimeType(boost::string_view path);  // 未知扩展名按 text/plain 发送
+  static bool compressible(boost::string_view path);  // 未知扩展名按 application/octet-stream 判断，不压缩
 
-  HttpConnection(const std::string& sourceDir);
+  // bufferPool 非空时输出缓冲区的存储从中借用，没有待发送数据时归还（只能在 pool 所属的 loop 线程中使用）
+  HttpConnection(const HttpConfig& config, FileCache* fileCache, GzipCompressor* compressor,
+                 BufferPool* bufferPool = nullptr);
   ~HttpConnection() = default;
 
   void processMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp);
+  void onHighWaterMark(const TcpConnectionPtr& conn);
+  void onWriteComplete(const TcpConnectionPtr& conn);
+  void onDiskRead(const TcpConnectionPtr& conn, const char* data, size_t n, size_t expected, int err);
+  size_t outputHighWaterMark() const;
+  size_t memoryUsage() const;  // 对象本身、缓冲区和 arena 占用的字节数
+  // 处理 inputBuf 中所有完整的请求，响应追加到 outputBuf，返回 true 表示发送后应关闭连接
+  // conn 非空时大文件经 TcpConnection::sendFile 发送（或排入分块发送），此前会先把 outputBuf 中已有的内容 send 出去，
+  // 之后或 outputBuf 积压过多时提前返回，剩余的请求留在 inputBuf 中
+  bool handleMessage(Buffer* inputBuf, Buffer* outputBuf, TcpConnection* conn = nullptr);
+  void recycle();  // 清空所有连接级状态，供 HttpConnectionPool 复用
   void setTimerId(TimerId timerId) { timerId_ = timerId; }
   TimerId getTimerId() const { return timerId_; }
   
  private:
-  HttpCode parseRequest(Buffer* inputBuf);
-  HttpCode parseRequestLine(const std::string& line);
-  HttpCode parseRequestHeader(const std::string& line);
-  HttpCode parseRequestBody(const std::string& line);
+  HttpCode parseRequest(Buffer* inputBuf, Buffer* outputBuf);
+  HttpCode parseRequestLine();
+  static bool normalizePath(boost::string_view target, ArenaString* out);
+  void selectEncoding();
+  HttpCode parseRange();
+  bool ifRangeMatches() const;
+  bool willCompress() const;
+  void compressBody();
+  bool notModified() const;
+  int formatETag(char* buf, size_t len) const;  // 实际发送的表示的 ETag，动态压缩的在引号内加 "-gzip"
+  int maxAge() const;
+  HttpCode parseRequestHeader(Buffer* inputBuf, Buffer* outputBuf);
+  HttpCode parseRequestBody();
 
   HttpCode parsePost();
-  HttpCode parseFromUrlEncode();
+  bool decodeForm(const char* data, size_t len);  // 表单请求体的 HttpBody::DataCallback，边接收边解码
+  bool endFormField();
+  HttpCode finishForm();
   HttpCode userVerify();
 
-  void makeResponse(Buffer* outputBuf, HttpCode parseRet);
+  void makeResponse(Buffer* outputBuf, HttpCode parseRet, TcpConnection* conn);
   void initResponse(HttpCode httpCode);
   void makeResponseLine(Buffer* outputBuf);
   void makeResponseHeader(Buffer* outputBuf);
-  void makeResponseBody(Buffer* outputBuf);
+  // 文件读取失败返回 false；inlineBody 为 true 时文件内容要放入 outputBuf（用于 ResponseCache），不用 sendfile
+  bool makeResponseBody(Buffer* outputBuf, TcpConnection* conn, bool inlineBody);
+  bool appendFile(Buffer* outputBuf, TcpConnection* conn, const FileCache::EntryPtr& file,
+                  off_t offset, size_t length, bool inlineBody);
+  void appendShared(Buffer* outputBuf, TcpConnection* conn, const std::shared_ptr<const std::string>& blob,
+                    bool inlineBody);
+  size_t readFile(int fd, char* buf, size_t length, off_t offset, bool* wouldBlock);
+  int formatPartHeader(char* buf, size_t len, size_t i) const;  // multipart 中第 i 个范围之前的分隔行和首部
+  size_t contentLength() const;
+  bool wantKeepAlive() const;
+  unsigned cacheVariant() const;  // ResponseCache 的 variant：keep-alive | 接受 gzip
+  const FileCache::Entry& bodyFile() const { return gzipFile_ ? *gzipFile_ : *file_; }
+
+  size_t backlog(const Buffer* outputBuf, const TcpConnection* conn) const;
+  void pause(const TcpConnectionPtr& conn);
+  void holdTail(Buffer* outputBuf);  // 把 outputBuf 中的数据排到最后一个分块发送的文件之后
+  void queueRegion(Buffer* outputBuf, TcpConnection* conn, const FileCache::EntryPtr& file,
+                   off_t offset, size_t length);
+  void sendChunk(const TcpConnectionPtr& conn);
+  void finishChunk(const TcpConnectionPtr& conn);
+  void abortStream(const TcpConnectionPtr& conn);
 
   void resetState();
 
   ParseState parseState_;
 
-  std::string method_, path_, version_;  // request line
-  std::map<std::string, std::string> header_;
-  std::string body_;
-  std::map<std::string, std::string> post_;
+  // 单个请求内的临时数据都分配在 arena_ 上，resetState() 时整体回收
+  Arena arena_;
+  HttpParser parser_;  // method/version/header 都是指向 input buffer（有请求体时为 arena_ 中拷贝）的 view
+  ArenaString path_;  // 规范化后相对资源目录的路径
+  bool hasBody_;  // 首部是否已从 input buffer 中取走
+  HttpBody body_;
+  struct FormField {  // postBuf_ 中的偏移，接收过程中 postBuf_ 会扩容，不能保存 view
+    size_t keyBegin;
+    size_t valueBegin;
+    size_t end;
+  };
+  Buffer postBuf_;  // 解码后的表单数据，存储从 BufferPool 借用，扩容时旧块归还（arena 中扩容会丢下旧块）
+  FormField post_[kMaxPostFields];
+  size_t numPost_;
+  size_t fieldBegin_;  // 正在解码的字段在 postBuf_ 中的起点
+  size_t valueBegin_;  // 正在解码的字段中值的起点，还没有遇到 '=' 时为 npos
+  int hexDigits_;  // '%' 之后还差几个十六进制数字，可能跨越两次回调
+  int hexByte_;
+  HttpCode formError_;  // decodeForm() 中止接收的原因，body_ 只返回 kError
 
   int responseCode_;
   bool keepAlive_;
-  struct stat requestFileStat_;
+  FileCache::EntryPtr file_;  // path_ 对应的文件
+  FileCache::EntryPtr gzipFile_;  // 非空时发送预压缩的 path_.gz
+  bool acceptGzip_;
+  bool vary_;  // 可压缩类型，响应带 Vary: Accept-Encoding
+  GzipCompressor::Output compressedBody_;  // 动态压缩的结果，非空时代替文件内容发送
+  ResponseCache::Blob cachedResponse_;  // 命中 ResponseCache 时不再查 FileCache
+  struct ByteRange {
+    off_t first;
+    off_t last;  // 闭区间
+  };
+  ByteRange ranges_[kMaxRanges];  // 按 first 升序且互不相邻
+  size_t numRanges_;  // 非 0 时响应 206
+  off_t completeLength_;  // Range 针对的文件长度，416 时 file_ 已替换为错误页面
+  char boundary_[24];  // multipart/byteranges 的分隔串
+  Buffer responseBuf_;  // 一次读事件中所有响应的批量输出
+
+  // 不用 sendfile 时分块发送的文件区间，以及不在 page cache 中、要由 DiskIoPool 读取的小文件，跨越 resetState()，直到发完
+  struct StreamRegion {
+    FileCache::EntryPtr file;
+    off_t offset;
+    size_t length;
+    size_t tail;  // 这一段之后要发送的 streamTail_ 中的字节数（multipart 的分隔行和较小的范围）
+  };
+  std::vector<StreamRegion> streams_;
+  Buffer streamTail_;
+  Buffer streamBuf_;  // 当前块
+  bool paused_;  // 等待 WriteCompleteCallback，期间收到的请求留在 input buffer 中
+  bool reading_;  // 当前块正由 DiskIoPool 读取
+  bool closeAfterSend_;
 
   TimerId timerId_;  // for the shutdown in timeout
 
-  const std::string kSourceDir;
+  const HttpConfig& config_;  // 由 HttpConnectionPool 共享持有
+  FileCache* fileCache_;      // 所属 loop 的缓存
+  GzipCompressor* compressor_;
 };
 
-typedef std::shared_ptr<HttpConnection> HttpConnectionPtr;
-
 
 void onConnection(const TcpConnectionPtr& conn);
 void onMessage(const TcpConnectionPtr& conn, Buffer* buf, Timestamp t);
+void onHighWaterMark(const TcpConnectionPtr& conn, size_t bytes);
+void onWriteComplete(const TcpConnectionPtr& conn);
 
 
 #endif  // HTTPCONNECTION_H
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "HttpConnectionPool.h"
+#include "HttpConnection.h"
+#include "HttpConfig.h"
+#include "ResponseCache.h"
+#include "base/EventLoop.h"
+#include "base/Logging.h"
+
+#include <boost/any.hpp>
+
+
+typedef std::shared_ptr<HttpConnectionPool> HttpConnectionPoolPtr;
+
+HttpConnectionPool::HttpConnectionPool(EventLoop* loop, const std::shared_ptr<HttpConfig>& config, size_t maxIdle)
+  : loop_(loop),
+    config_(config),
+    fileCache_(loop, config->sourceDir),
+    compressor_(config->gzipLevel, config->gzipCacheCapacity),
+    maxIdle_(maxIdle),
+    inUse_(0),
+    acquires_(0),
+    hits_(0)
+{
+  if (config->responseCache) {
+    ResponseCache* cache = config->responseCache.get();
+    fileCache_.setInvalidateCallback([cache](boost::string_view path) {
+      cache->invalidate(path);
+      if (path.ends_with(".gz")) {  // 预压缩文件变化时，原文件路径下缓存的 gzip 响应也要作废
+        path.remove_suffix(3);
+        cache->invalidate(path);
+      }
+    });
+  }
+}
+
+HttpConnectionPool::~HttpConnectionPool() {
+  LOG_INFO << "HttpConnectionPool of loop " << loop_ << ": acquires = " << acquires_
+           << ", hit rate = " << hitRate() << ", idle = " << free_.size()
+           << ", in use = " << inUse_;
+}
+
+void HttpConnectionPool::initLoop(EventLoop* loop, const std::shared_ptr<HttpConfig>& config) {
+  loop->setContext(HttpConnectionPoolPtr(new HttpConnectionPool(loop, config)));
+}
+
+HttpConnectionPool* HttpConnectionPool::of(EventLoop* loop) {
+  return boost::any_cast<const HttpConnectionPoolPtr&>(loop->getContext()).get();
+}
+
+HttpConnection* HttpConnectionPool::acquire() {
+  loop_->assertInLoopThread();
+  ++acquires_;
+  ++inUse_;
+  if (free_.empty()) {
+    return new HttpConnection(*config_, &fileCache_, &compressor_, loop_->bufferPool());
+  }
+  ++hits_;
+  HttpConnection* conn = free_.back().release();
+  free_.pop_back();
+  return conn;
+}
+
+void HttpConnectionPool::release(HttpConnection* conn) {
+  loop_->assertInLoopThread();
+  assert(inUse_ > 0);
+  --inUse_;
+  if (free_.size() >= maxIdle_) {
+    delete conn;
+    return;
+  }
+  conn->recycle();
+  free_.emplace_back(conn);
+}
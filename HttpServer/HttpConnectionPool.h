@@ -0,0 +1,59 @@
+#ifndef HTTPCONNECTIONPOOL_H
+#define HTTPCONNECTIONPOOL_H
+
+#include "base/noncopyable.h"
+#include "FileCache.h"
+#include "Compression.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class EventLoop;
+class HttpConnection;
+struct HttpConfig;
+
+
+/*
+  每个 EventLoop 一个 HttpConnection 对象池，只在所属 loop 线程中使用，无需加锁
+  连接建立时 acquire()，断开时 release()，对象 recycle() 后放回空闲链表复用，
+  避免短连接下反复 new/delete 及 map/Buffer 的重新分配
+  同时持有该 loop 的 FileCache 和 GzipCompressor，供池中所有 HttpConnection 使用
+  通过 TcpServer::setThreadInitCallback(std::bind(HttpConnectionPool::initLoop, _1, config)) 挂到各个 EventLoop 的 context 上
+*/
+
+class HttpConnectionPool : noncopyable {
+ public:
+  static const size_t kDefaultMaxIdle = 1024;
+
+  HttpConnectionPool(EventLoop* loop, const std::shared_ptr<HttpConfig>& config, size_t maxIdle = kDefaultMaxIdle);
+  ~HttpConnectionPool();
+
+  static void initLoop(EventLoop* loop, const std::shared_ptr<HttpConfig>& config);  // 绑定 config 后作为 ThreadInitCallback
+  static HttpConnectionPool* of(EventLoop* loop);
+
+  HttpConnection* acquire();
+  void release(HttpConnection* conn);
+
+  size_t idle() const { return free_.size(); }  // 空闲对象数
+  size_t inUse() const { return inUse_; }
+  size_t acquires() const { return acquires_; }
+  size_t hits() const { return hits_; }
+  FileCache* fileCache() { return &fileCache_; }
+
+  double hitRate() const { return acquires_ == 0 ? 0.0 : static_cast<double>(hits_) / acquires_; }
+
+ private:
+  EventLoop* loop_;
+  const std::shared_ptr<HttpConfig> config_;  // 所有 loop 的 HttpConnection 共享这一份
+  FileCache fileCache_;
+  GzipCompressor compressor_;
+  const size_t maxIdle_;
+  std::vector<std::unique_ptr<HttpConnection>> free_;
+  size_t inUse_;
+  size_t acquires_;
+  size_t hits_;
+};
+
+
+#endif  // HTTPCONNECTIONPOOL_H
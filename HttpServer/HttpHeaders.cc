@@ -0,0 +1,184 @@
+#include "HttpHeaders.h"
+
+#include <string.h>
+#include <strings.h>
+
+
+namespace
+{
+
+// 与 HttpHeaders::Field 一一对应，必须为小写
+constexpr const char* kFieldNames[HttpHeaders::kNumFields] = {
+  "host",
+  "connection",
+  "content-length",
+  "content-type",
+  "transfer-encoding",
+  "expect",
+  "accept-encoding",
+  "range",
+  "if-range",
+  "if-none-match",
+  "if-modified-since",
+  "user-agent",
+  "accept",
+  "accept-language",
+  "cookie",
+  "keep-alive",
+  "referer",
+  "cache-control",
+};
+
+const size_t kHashSize = 32;
+
+constexpr char toLower(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+constexpr size_t constLength(const char* s) {
+  size_t n = 0;
+  while (s[n] != '\0') {
+    ++n;
+  }
+  return n;
+}
+
+// 只看长度、首字符、尾字符，常数由离线搜索得到，对上面的名字无冲突
+constexpr size_t fieldHash(const char* s, size_t len) {
+  return (len + static_cast<size_t>(toLower(s[0])) * 28
+              + static_cast<size_t>(toLower(s[len-1])) * 19) % kHashSize;
+}
+
+struct HashTable {
+  int8_t slot[kHashSize];
+};
+
+constexpr HashTable makeHashTable() {
+  HashTable table{};
+  for (size_t i = 0; i < kHashSize; ++i) {
+    table.slot[i] = -1;
+  }
+  for (int i = 0; i < HttpHeaders::kNumFields; ++i) {
+    table.slot[fieldHash(kFieldNames[i], constLength(kFieldNames[i]))] = static_cast<int8_t>(i);
+  }
+  return table;
+}
+
+constexpr bool isPerfectHash() {
+  HashTable table = makeHashTable();
+  int used = 0;
+  for (size_t i = 0; i < kHashSize; ++i) {
+    used += table.slot[i] >= 0;
+  }
+  return used == HttpHeaders::kNumFields;
+}
+
+static_assert(isPerfectHash(), "header field hash has collisions, choose new constants");
+
+constexpr HashTable kHashTable = makeHashTable();
+
+} // namespace
+
+
+HttpHeaders::Field HttpHeaders::lookup(boost::string_view name) {
+  if (name.empty()) {
+    return kUnknown;
+  }
+  int8_t i = kHashTable.slot[fieldHash(name.data(), name.size())];
+  if (i < 0) {
+    return kUnknown;
+  }
+  const char* expected = kFieldNames[i];
+  for (char c : name) {  // expected 为小写
+    if (*expected == '\0' || toLower(c) != *expected) {
+      return kUnknown;
+    }
+    ++expected;
+  }
+  return *expected == '\0' ? static_cast<Field>(i) : kUnknown;
+}
+
+bool HttpHeaders::equalsIgnoreCase(boost::string_view lhs, boost::string_view rhs) {
+  return lhs.size() == rhs.size()
+         && ::strncasecmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+}
+
+void HttpHeaders::formatDate(time_t t, char* buf) {
+  struct tm tm;
+  ::gmtime_r(&t, &tm);
+  ::strftime(buf, kDateLength + 1, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+bool HttpHeaders::parseDate(boost::string_view value, time_t* t) {
+  static const char* const kFormats[] = {
+    "%a, %d %b %Y %H:%M:%S GMT",  // IMF-fixdate
+    "%A, %d-%b-%y %H:%M:%S GMT",  // RFC 850
+    "%a %b %e %H:%M:%S %Y",       // asctime
+  };
+
+  char buf[64];  // strptime 需要以 '\0' 结尾
+  if (value.size() >= sizeof(buf)) {
+    return false;
+  }
+  memcpy(buf, value.data(), value.size());
+  buf[value.size()] = '\0';
+
+  for (const char* format : kFormats) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = ::strptime(buf, format, &tm);
+    if (end != nullptr && *end == '\0') {
+      *t = ::timegm(&tm);
+      return true;
+    }
+  }
+  return false;
+}
+
+HttpHeaders::HttpHeaders()
+  : base_(nullptr),
+    size_(0)
+{
+  memset(known_, -1, sizeof(known_));
+}
+
+void HttpHeaders::reset() {
+  base_ = nullptr;
+  size_ = 0;
+  memset(known_, -1, sizeof(known_));
+}
+
+bool HttpHeaders::add(size_t nameOff, size_t nameLen, size_t valueOff, size_t valueLen) {
+  if (size_ == kMaxHeaders) {
+    return false;
+  }
+
+  Entry& e = entries_[size_];
+  e.nameOff = static_cast<uint32_t>(nameOff);
+  e.nameLen = static_cast<uint16_t>(nameLen);
+  e.valueOff = static_cast<uint32_t>(valueOff);
+  e.valueLen = static_cast<uint16_t>(valueLen);
+
+  Field field = lookup(name(e));
+  if (field != kUnknown) {
+    if (known_[field] >= 0) {  // 重复的首部保留第一个，但 Content-Length 重复可能是请求走私
+      return field != kContentLength || value(entries_[known_[field]]) == value(e);
+    }
+    known_[field] = static_cast<int8_t>(size_);
+  }
+  ++size_;
+  return true;
+}
+
+boost::string_view HttpHeaders::find(boost::string_view name) const {
+  Field field = lookup(name);
+  if (field != kUnknown) {
+    return get(field);
+  }
+  for (size_t i = 0; i < size_; ++i) {
+    if (equalsIgnoreCase(this->name(entries_[i]), name)) {
+      return value(entries_[i]);
+    }
+  }
+  return boost::string_view();
+}
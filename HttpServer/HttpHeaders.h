@@ -0,0 +1,93 @@
+#ifndef HTTPHEADERS_H
+#define HTTPHEADERS_H
+
+#include "base/noncopyable.h"
+
+#include <stdint.h>
+#include <time.h>
+#include <boost/utility/string_view.hpp>
+
+
+/*
+  请求首部表，全部存储在对象内部，不做堆分配
+  entries_ 按到达顺序保存每个首部在 input buffer 中的偏移，访问时再基于 base_ 转为 string_view，
+  因此 Buffer 搬移数据后只需 setBase() 即可
+  常用首部通过编译期完美哈希映射到 Field，并在 known_ 中占固定槽位，名字比较大小写不敏感
+*/
+
+class HttpHeaders : noncopyable {
+ public:
+  enum Field {
+    kHost,
+    kConnection,
+    kContentLength,
+    kContentType,
+    kTransferEncoding,
+    kExpect,
+    kAcceptEncoding,
+    kRange,
+    kIfRange,
+    kIfNoneMatch,
+    kIfModifiedSince,
+    kUserAgent,
+    kAccept,
+    kAcceptLanguage,
+    kCookie,
+    kKeepAlive,
+    kReferer,
+    kCacheControl,
+    kNumFields,
+    kUnknown = kNumFields,
+  };
+
+  struct Header {
+    boost::string_view name;
+    boost::string_view value;
+  };
+
+  static const size_t kMaxHeaders = 64;
+
+  static Field lookup(boost::string_view name);
+  static bool equalsIgnoreCase(boost::string_view lhs, boost::string_view rhs);
+
+  // HTTP-date，生成 IMF-fixdate（"Sun, 06 Nov 1994 08:49:37 GMT"），解析时还接受 RFC 850 和 asctime 格式
+  static const size_t kDateLength = 29;
+  static void formatDate(time_t t, char* buf);  // buf 至少 kDateLength + 1 字节
+  static bool parseDate(boost::string_view value, time_t* t);
+
+  HttpHeaders();
+
+  void reset();
+  void setBase(const char* base) { base_ = base; }
+
+  // 偏移均相对 base_，首部过多或重复的 Content-Length 返回 false
+  bool add(size_t nameOff, size_t nameLen, size_t valueOff, size_t valueLen);
+
+  size_t size() const { return size_; }
+  Header at(size_t i) const { return Header{ name(entries_[i]), value(entries_[i]) }; }
+
+  boost::string_view get(Field field) const {
+    int8_t i = known_[field];
+    return i < 0 ? boost::string_view() : value(entries_[i]);
+  }
+  boost::string_view find(boost::string_view name) const;  // 不存在时返回空
+
+ private:
+  struct Entry {
+    uint32_t nameOff;
+    uint32_t valueOff;
+    uint16_t nameLen;
+    uint16_t valueLen;
+  };
+
+  boost::string_view name(const Entry& e) const { return boost::string_view(base_ + e.nameOff, e.nameLen); }
+  boost::string_view value(const Entry& e) const { return boost::string_view(base_ + e.valueOff, e.valueLen); }
+
+  const char* base_;
+  size_t size_;
+  int8_t known_[kNumFields];  // Field -> entries_ 下标，-1 表示不存在
+  Entry entries_[kMaxHeaders];
+};
+
+
+#endif  // HTTPHEADERS_H
@@ -0,0 +1,125 @@
+#include "HttpParser.h"
+#include "base/Buffer.h"
+#include "base/Logging.h"
+#include "base/StringSearch.h"
+
+
+HttpParser::HttpParser()
+  : state_(kRequestLine),
+    base_(nullptr),
+    lineStart_(0),
+    scanned_(0),
+    method_{0, 0},
+    path_{0, 0},
+    version_{0, 0}
+  {}
+
+void HttpParser::reset() {
+  state_ = kRequestLine;
+  base_ = nullptr;
+  lineStart_ = 0;
+  scanned_ = 0;
+  method_ = path_ = version_ = Span{0, 0};
+  headers_.reset();
+}
+
+HttpParser::Result HttpParser::parse(const Buffer* buf) {
+  base_ = buf->beginRead();
+  headers_.setBase(base_);
+  if (state_ == kDone) {
+    return kComplete;
+  }
+
+  const size_t readable = buf->readableBytes();
+  while (state_ != kDone) {
+    const char* crlf = buf->findLineBreak(base_ + scanned_);
+    if (crlf == nullptr || crlf + 1 == buf->beginWrite()) {  // 没有换行，或只收到了 '\r'
+      scanned_ = crlf == nullptr ? readable : static_cast<size_t>(crlf - base_);
+      if (readable - lineStart_ > kMaxHeaderSize) {
+        LOG_DEBUG << "HttpParser::parse(): line too long";
+        return kError;
+      }
+      return kIncomplete;
+    }
+    if (*crlf != '\r' || crlf[1] != '\n') {  // 行内单独出现的 CR/LF 视为格式错误，防止请求走私
+      LOG_DEBUG << "HttpParser::parse(): bare CR or LF";
+      return kError;
+    }
+
+    size_t eol = static_cast<size_t>(crlf - base_);
+    size_t begin = lineStart_;
+    lineStart_ = scanned_ = eol + 2;
+    if (scanned_ > kMaxHeaderSize) {
+      LOG_DEBUG << "HttpParser::parse(): header too large";
+      return kError;
+    }
+
+    bool ok = state_ == kRequestLine ? parseRequestLine(begin, eol)
+                                     : parseHeaderLine(begin, eol);
+    if (!ok) {
+      return kError;
+    }
+  }
+  return kComplete;
+}
+
+// METHOD SP request-target SP HTTP/version
+bool HttpParser::parseRequestLine(size_t begin, size_t end) {
+  const char* p = base_ + begin;
+  const char* last = base_ + end;
+
+  const char* sp1 = StringSearch::findChar(p, last, ' ');
+  if (sp1 == nullptr || sp1 == p) {
+    LOG_DEBUG << "HttpParser::parseRequestLine(): bad method";
+    return false;
+  }
+  const char* sp2 = StringSearch::findChar(sp1+1, last, ' ');
+  if (sp2 == nullptr || sp2 == sp1+1) {
+    LOG_DEBUG << "HttpParser::parseRequestLine(): bad path";
+    return false;
+  }
+  const char* ver = sp2 + 1;
+  if (last - ver <= 5 || memcmp(ver, "HTTP/", 5) != 0
+      || StringSearch::findChar(ver, last, ' ') != nullptr) {
+    LOG_DEBUG << "HttpParser::parseRequestLine(): bad version";
+    return false;
+  }
+
+  method_ = Span{ begin, static_cast<size_t>(sp1 - p) };
+  path_ = Span{ static_cast<size_t>(sp1 + 1 - base_), static_cast<size_t>(sp2 - sp1 - 1) };
+  version_ = Span{ static_cast<size_t>(ver + 5 - base_), static_cast<size_t>(last - ver - 5) };
+  state_ = kHeaders;
+  return true;
+}
+
+// field-name ":" OWS field-value OWS
+bool HttpParser::parseHeaderLine(size_t begin, size_t end) {
+  if (begin == end) {  // header 末尾的空行
+    state_ = kDone;
+    return true;
+  }
+
+  const char* p = base_ + begin;
+  const char* last = base_ + end;
+  const char* colon = StringSearch::findChar(p, last, ':');
+  if (colon == nullptr || colon == p || colon[-1] == ' ' || colon[-1] == '\t') {
+    LOG_DEBUG << "HttpParser::parseHeaderLine(): bad header";
+    return false;
+  }
+
+  const char* value = colon + 1;
+  while (value < last && (*value == ' ' || *value == '\t')) {
+    ++value;
+  }
+  const char* valueEnd = last;
+  while (valueEnd > value && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')) {
+    --valueEnd;
+  }
+
+  if (!headers_.add(begin, static_cast<size_t>(colon - p),
+                    static_cast<size_t>(value - base_), static_cast<size_t>(valueEnd - value))) {
+    LOG_DEBUG << "HttpParser::parseHeaderLine(): too many or conflicting headers";
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,74 @@
+#ifndef HTTPPARSER_H
+#define HTTPPARSER_H
+
+#include "base/noncopyable.h"
+#include "HttpHeaders.h"
+
+#include <boost/utility/string_view.hpp>
+
+class Buffer;
+
+
+/*
+  增量式 HTTP/1.1 请求解析器（请求行 + 首部），直接在 Buffer::beginRead() 上扫描，不拷贝
+  内部只记录相对 beginRead() 的偏移，Buffer 扩容/搬移后仍然有效
+  parse() 返回 kIncomplete 时保留扫描位置，下次只扫描新到达的字节
+  method()/path()/version()/headers() 返回指向 input buffer 的 string_view，
+  在下一次修改该 Buffer（retrieve/append）前有效
+*/
+
+class HttpParser : noncopyable {
+ public:
+  enum Result {
+    kIncomplete,
+    kComplete,
+    kError,
+  };
+
+  static const size_t kMaxHeaderSize = 64 * 1024;
+
+  HttpParser();
+
+  Result parse(const Buffer* buf);
+  void reset();
+  // 首部已整体拷贝到 base 处（input buffer 需要先 retrieve 首部时），view 改为指向拷贝，之后不能再 parse()
+  void rebase(const char* base) { base_ = base; headers_.setBase(base); }
+
+  bool finished() const { return state_ == kDone; }
+  size_t headerLength() const { return scanned_; }  // 请求行 + 首部 + 空行的总字节数，finished() 后有效
+
+  boost::string_view method() const { return view(method_); }
+  boost::string_view path() const { return view(path_); }
+  boost::string_view version() const { return view(version_); }  // "1.1"
+  const HttpHeaders& headers() const { return headers_; }
+  boost::string_view header(HttpHeaders::Field field) const { return headers_.get(field); }
+  boost::string_view findHeader(boost::string_view name) const { return headers_.find(name); }  // 大小写不敏感，不存在时返回空
+
+ private:
+  enum State {
+    kRequestLine,
+    kHeaders,
+    kDone,
+  };
+
+  struct Span {
+    size_t off;
+    size_t len;
+  };
+
+  boost::string_view view(Span s) const { return boost::string_view(base_ + s.off, s.len); }
+
+  bool parseRequestLine(size_t begin, size_t end);
+  bool parseHeaderLine(size_t begin, size_t end);
+
+  State state_;
+  const char* base_;  // 最近一次 parse() 时的 beginRead()
+  size_t lineStart_;  // 当前行起始偏移
+  size_t scanned_;    // 已扫描过的字节数，下次从这里继续找 CRLF
+
+  Span method_, path_, version_;
+  HttpHeaders headers_;
+};
+
+
+#endif  // HTTPPARSER_H
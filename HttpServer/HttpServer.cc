@@ -1,4 +1,9 @@
 #include "HttpConnection.h"
+#include "HttpConnectionPool.h"
+#include "HttpConfig.h"
+#include "ResponseCache.h"
+#include "Compression.h"
+#include "DiskIoPool.h"
 #include "base/EventLoop.h"
 #include "base/TcpServer.h"
 #include "base/Acceptor.h"
@@ -6,8 +11,18 @@
 #include "base/TcpConnection.h"
 #include "base/Logging.h"
 
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+
+int main(int argc, char* argv[]) {
+  if (argc == 3 && strcmp(argv[1], "--precompress") == 0) {  // 离线生成 .gz，见 CMake 目标 precompress
+    size_t n = Compression::precompressTree(argv[2], HttpConfig().precompressMinSize);
+    printf("%zu files precompressed\n", n);
+    return 0;
+  }
 
-int main() {
   Logger::setLogLevel(Logger::TRACE);
   Logger::useAsyncLog("./log/http", 1024*1024);
 
@@ -17,7 +32,24 @@ int main() {
 
   server.setConnectionCallback(onConnection);
   server.setMessageCallback(onMessage);
+  std::shared_ptr<HttpConfig> config = std::make_shared<HttpConfig>();
+  if (config->precompress) {
+    LOG_INFO << Compression::precompressTree(config->sourceDir, config->precompressMinSize)
+             << " files precompressed";
+  }
+  config->responseCache = std::make_shared<ResponseCache>(config->responseCacheCapacity,
+                                                          config->responseCacheMaxObjectSize);
+  config->diskIoPool = std::make_shared<DiskIoPool>(config->diskIoThreads);
+  loop.runEvery([config] {
+    LOG_INFO << "ResponseCache: " << config->responseCache->stats();
+    LOG_INFO << "DiskIoPool: " << config->diskIoPool->stats();
+  }, 60);
+  server.setThreadInitCallback(std::bind(HttpConnectionPool::initLoop, std::placeholders::_1, config));
 
+  const char* edgeTriggered = ::getenv("USE_EPOLLET");  // 与 USE_IO_URING 一样由环境变量打开，0 表示关闭
+  server.setEdgeTriggered(edgeTriggered != nullptr && strcmp(edgeTriggered, "0") != 0);
+  const char* zeroCopy = ::getenv("ZEROCOPY_THRESHOLD");  // 如 65536，缓存的响应等不小于该大小时用 MSG_ZEROCOPY 发送
+  server.setZeroCopyThreshold(zeroCopy != nullptr ? strtoul(zeroCopy, nullptr, 10) : 0);
   server.setThreadNum(6);
   server.start();
   loop.loop();
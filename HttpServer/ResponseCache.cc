@@ -0,0 +1,117 @@
+#include "ResponseCache.h"
+#include "base/Logging.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+
+ResponseCache::ResponseCache(size_t capacity, size_t maxObjectSize)
+  : capacity_(capacity),
+    maxObjectSize_(maxObjectSize),
+    bytes_(0),
+    hits_(0),
+    misses_(0),
+    evictions_(0)
+  {}
+
+ResponseCache::~ResponseCache() {
+  LOG_INFO << "ResponseCache: " << stats();
+}
+
+ResponseCache::Blob ResponseCache::get(boost::string_view path, unsigned variant) {
+  assert(variant < kNumVariants);
+  MutexLockGuard lock(mutex_);
+  Index& index = index_[variant];
+  auto it = index.find(path);
+  if (it == index.end()) {
+    ++misses_;
+    return Blob();
+  }
+  ++hits_;
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return it->second->blob;
+}
+
+void ResponseCache::put(boost::string_view path, unsigned variant, Blob blob) {
+  assert(variant < kNumVariants);
+  if (blob->size() > capacity_) {
+    return;
+  }
+  Node node{ std::string(path.data(), path.size()), variant, std::move(blob) };  // 在锁外分配
+
+  MutexLockGuard lock(mutex_);
+  Index& index = index_[variant];
+  auto it = index.find(path);
+  if (it != index.end()) {  // 其他线程已经放入
+    return;
+  }
+
+  bytes_ += node.blob->size();
+  lru_.push_front(std::move(node));
+  index.emplace(boost::string_view(lru_.front().path), lru_.begin());
+
+  while (bytes_ > capacity_) {
+    erase(std::prev(lru_.end()));
+    ++evictions_;
+  }
+}
+
+void ResponseCache::invalidate(boost::string_view path) {
+  MutexLockGuard lock(mutex_);
+  if (path.empty()) {
+    lru_.clear();
+    for (Index& index : index_) {
+      index.clear();
+    }
+    bytes_ = 0;
+    return;
+  }
+  for (Index& index : index_) {
+    auto it = index.find(path);
+    if (it != index.end()) {
+      erase(it->second);
+    }
+  }
+}
+
+void ResponseCache::erase(LruList::iterator it) {
+  bytes_ -= it->blob->size();
+  index_[it->variant].erase(boost::string_view(it->path));
+  lru_.erase(it);
+}
+
+size_t ResponseCache::bytes() const {
+  MutexLockGuard lock(mutex_);
+  return bytes_;
+}
+
+size_t ResponseCache::entries() const {
+  MutexLockGuard lock(mutex_);
+  return lru_.size();
+}
+
+size_t ResponseCache::hits() const {
+  MutexLockGuard lock(mutex_);
+  return hits_;
+}
+
+size_t ResponseCache::misses() const {
+  MutexLockGuard lock(mutex_);
+  return misses_;
+}
+
+size_t ResponseCache::evictions() const {
+  MutexLockGuard lock(mutex_);
+  return evictions_;
+}
+
+std::string ResponseCache::stats() const {
+  MutexLockGuard lock(mutex_);
+  size_t lookups = hits_ + misses_;
+  char buf[256];
+  snprintf(buf, sizeof(buf), "hits = %zu, misses = %zu, hit rate = %.3f, evictions = %zu, "
+           "entries = %zu, bytes = %zu/%zu",
+           hits_, misses_, lookups == 0 ? 0.0 : static_cast<double>(hits_) / lookups,
+           evictions_, lru_.size(), bytes_, capacity_);
+  return buf;
+}
@@ -0,0 +1,70 @@
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include "base/noncopyable.h"
+#include "base/Mutex.h"
+#include "FileCache.h"
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <boost/utility/string_view.hpp>
+
+
+/*
+  热点小文件的完整响应缓存（状态行 + 首部 + 文件内容），所有 EventLoop 线程共享，由一把锁保护
+  响应以不可变的 shared_ptr<const std::string> 保存，命中时只需一次查找，然后把 blob 写入 socket，
+  不再 stat/open/pread，也不再格式化首部
+  同一路径按请求的特征分为若干 variant（如 keep-alive/close、是否接受 gzip），由调用方编号，分别缓存
+  总字节数超过 capacity 时按 LRU 淘汰；文件变化时由 FileCache 的 InvalidateCallback 调用 invalidate()
+*/
+
+class ResponseCache : noncopyable {
+ public:
+  typedef std::shared_ptr<const std::string> Blob;
+
+  static const unsigned kNumVariants = 4;
+
+  ResponseCache(size_t capacity, size_t maxObjectSize);
+  ~ResponseCache();
+
+  bool admit(size_t bodySize) const { return bodySize <= maxObjectSize_; }
+
+  Blob get(boost::string_view path, unsigned variant);  // 未命中返回空
+  void put(boost::string_view path, unsigned variant, Blob blob);
+  void invalidate(boost::string_view path);  // path 为空表示全部
+
+  size_t capacity() const { return capacity_; }
+  size_t bytes() const;
+  size_t entries() const;
+  size_t hits() const;
+  size_t misses() const;
+  size_t evictions() const;
+  std::string stats() const;
+
+ private:
+  struct Node {
+    std::string path;  // index_ 中的 key 指向这里
+    unsigned variant;
+    Blob blob;
+  };
+  typedef std::list<Node> LruList;  // 表头为最近使用
+  typedef std::unordered_map<boost::string_view, LruList::iterator, FileCache::PathHash> Index;
+
+  void erase(LruList::iterator it);
+
+  const size_t capacity_;
+  const size_t maxObjectSize_;
+
+  mutable MutexLock mutex_;
+  LruList lru_;        // guarded by mutex_
+  Index index_[kNumVariants];  // guarded by mutex_
+  size_t bytes_;       // guarded by mutex_
+  size_t hits_;        // guarded by mutex_
+  size_t misses_;      // guarded by mutex_
+  size_t evictions_;   // guarded by mutex_
+};
+
+
+#endif  // RESPONSECACHE_H
@@ -1,6 +1,7 @@
 #include "Acceptor.h"
 #include "Logging.h"
 #include "EventLoop.h"
+#include "Proactor.h"
 
 #include <arpa/inet.h>
 #include <string.h>
@@ -75,6 +76,17 @@ void Socket::setKeepAlive(bool on) {
   }
 }
 
+bool Socket::setZeroCopy(bool on) {
+  int optval = on ? 1 : 0;
+  int ret = setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY,
+                       &optval, static_cast<socklen_t>(sizeof(optval)));
+  if (ret < 0) {
+    LOG_SYSERR << "Socket::setZeroCopy()";
+    return false;
+  }
+  return true;
+}
+
 void Socket::bindAddr(const InetAddress& addr) {
   int ret = ::bind(sockfd_, addr.sockaddr(), sizeof(struct sockaddr));
   if (ret < 0) {
@@ -148,25 +160,43 @@ void Acceptor::listen() {
   loop_->assertInLoopThread();
   listening_ = true;
   acceptSocket_.listen();
-  acceptChannel_.enableReading();
+  if (loop_->proactor() != nullptr) {
+    loop_->proactor()->startAccept(&acceptChannel_);
+  }
+  else {
+    acceptChannel_.enableReading();
+  }
 }
 
 void Acceptor::handleRead() {  // TODO: 一次读完所有等待接受的连接，不然连接较多时每次epoll只读一个，且LT模式下一直被唤醒，效率低。
   loop_->assertInLoopThread();
 
+  Proactor* proactor = loop_->proactor();
+  if (proactor != nullptr) {  // 连接已由 io_uring accept，完成事件中没有对端地址，用 getpeername 取
+    int err = 0;
+    proactor->takeAccepted(&acceptChannel_, &acceptedFds_, &err);
+    for (int connfd : acceptedFds_) {
+      struct sockaddr_in addr;
+      socklen_t addrLen = sizeof(addr);
+      InetAddress peerAddr;
+      if (::getpeername(connfd, static_cast<sockaddr*>(static_cast<void*>(&addr)), &addrLen) == 0) {
+        peerAddr.setSockaddr(addr);
+      }
+      newConnection(connfd, peerAddr);
+    }
+    acceptedFds_.clear();
+    if (err == 0) {
+      return;
+    }
+    // EMFILE 等错误仍由下面的同步 accept 处理
+  }
+
   // UPDATA (2023.2.25 循环 accept 到无新连接为止)
   while (true) {
     InetAddress peerAddr;
     int connfd = acceptSocket_.accept(&peerAddr);
     if (connfd >= 0) {
-      if (newConnectionCallback_) {
-        newConnectionCallback_(connfd, peerAddr);
-      }
-      else {
-        if (::close(connfd) < 0) {
-          LOG_SYSERR << "Socket::handleRead(), close connected fd error";
-        }
-      }
+      newConnection(connfd, peerAddr);
     }
     else {
       if (errno == EAGAIN) {
@@ -187,4 +217,15 @@ void Acceptor::handleRead() {  // TODO: 一次读完所有等待接受的连接
     }
   }
   
-}
\ No newline at end of file
+}
+
+void Acceptor::newConnection(int connfd, const InetAddress& peerAddr) {
+  if (newConnectionCallback_) {
+    newConnectionCallback_(connfd, peerAddr);
+  }
+  else {
+    if (::close(connfd) < 0) {
+      LOG_SYSERR << "Socket::handleRead(), close connected fd error";
+    }
+  }
+}
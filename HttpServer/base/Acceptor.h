@@ -7,6 +7,7 @@
 #include <functional>
 #include <netinet/in.h>
 #include <string>
+#include <vector>
 
 class EventLoop;
 
@@ -41,6 +42,7 @@ class Socket : noncopyable {
   void setReuseAddr(bool on);
   void setReusePort(bool on);
   void setKeepAlive(bool on);
+  bool setZeroCopy(bool on);  // SO_ZEROCOPY，内核不支持时返回 false
   void bindAddr(const InetAddress& addr);
 
   int accept(InetAddress* p_peerAddr);
@@ -69,12 +71,15 @@ class Acceptor : noncopyable {
   void handleRead();
 
  private:
+  void newConnection(int connfd, const InetAddress& peerAddr);
+
   EventLoop* loop_;
   Socket acceptSocket_;
   Channel acceptChannel_;
   NewConnectionCallback newConnectionCallback_;
   bool listening_;
   int idleFd_;
+  std::vector<int> acceptedFds_;  // proactor 模式下 multishot accept 得到的连接
 };
 
 
@@ -0,0 +1,50 @@
+#include "Arena.h"
+
+#include <assert.h>
+
+
+void Arena::reset() {
+  // 超过 kBlockSize 的块只为个别大请求服务，不长期占用内存
+  size_t kept = 0;
+  for (const Block& b : blocks_) {
+    if (b.size == kBlockSize) {
+      blocks_[kept++] = b;
+    }
+    else {
+      delete[] b.data;
+    }
+  }
+  blocks_.resize(kept);
+
+  cur_ = inline_;
+  end_ = inline_ + kInlineSize;
+  nextBlock_ = 0;
+}
+
+size_t Arena::reservedBytes() const {
+  size_t n = 0;
+  for (const Block& b : blocks_) {
+    n += b.size;
+  }
+  return n;
+}
+
+char* Arena::allocateSlow(size_t n, size_t align) {
+  while (nextBlock_ < blocks_.size()) {
+    const Block& b = blocks_[nextBlock_++];
+    char* p = alignUp(b.data, align);
+    if (n <= static_cast<size_t>(b.data + b.size - p)) {
+      end_ = b.data + b.size;
+      return p;
+    }
+  }
+
+  size_t size = n + align <= kBlockSize ? kBlockSize : n + align;
+  Block b = { new char[size], size };
+  blocks_.push_back(b);
+  nextBlock_ = blocks_.size();
+  char* p = alignUp(b.data, align);
+  assert(n <= static_cast<size_t>(b.data + b.size - p));
+  end_ = b.data + b.size;
+  return p;
+}
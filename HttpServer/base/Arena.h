@@ -0,0 +1,104 @@
+#ifndef REACTOR_BASE_ARENA_H
+#define REACTOR_BASE_ARENA_H
+
+#include "noncopyable.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+
+/*
+  bump-pointer 内存池，用于生命周期相同的一批小对象（如一次 HTTP 请求中的临时字符串）
+  allocate 只移动指针，不支持单独释放，reset() 后所有分配一并失效
+  先使用对象内的 kInlineSize 字节，不够时再申请 kBlockSize 的块；
+  reset() 保留这些块供下次复用，因此稳态下不会再调用 malloc，超大块则在 reset() 时归还
+*/
+
+class Arena : noncopyable {
+ public:
+  static const size_t kInlineSize = 512;
+  static const size_t kBlockSize = 4096;
+
+  Arena()
+    : cur_(inline_),
+      end_(inline_ + kInlineSize),
+      nextBlock_(0) {}
+
+  ~Arena() {
+    for (const Block& b : blocks_) {
+      delete[] b.data;
+    }
+  }
+
+  void* allocate(size_t n, size_t align = alignof(max_align_t)) {
+    char* p = alignUp(cur_, align);
+    if (n > static_cast<size_t>(end_ - p)) {
+      p = allocateSlow(n, align);
+    }
+    cur_ = p + n;
+    return p;
+  }
+
+  void reset();
+
+  size_t reservedBytes() const;  // 对象外已申请的字节数
+
+ private:
+  struct Block {
+    char* data;
+    size_t size;
+  };
+
+  static char* alignUp(char* p, size_t align) {
+    uintptr_t u = reinterpret_cast<uintptr_t>(p);
+    return reinterpret_cast<char*>((u + align - 1) & ~(static_cast<uintptr_t>(align) - 1));
+  }
+
+  char* allocateSlow(size_t n, size_t align);
+
+  alignas(max_align_t) char inline_[kInlineSize];
+  char* cur_;
+  char* end_;
+  std::vector<Block> blocks_;
+  size_t nextBlock_;  // blocks_ 中下一个可用的块
+};
+
+
+// 供标准容器使用的分配器，deallocate 为空操作，内存随 Arena::reset() 统一回收
+template <typename T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+
+  explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) {}
+
+  Arena* arena() const { return arena_; }
+
+ private:
+  Arena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) {
+  return lhs.arena() == rhs.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) {
+  return !(lhs == rhs);
+}
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> ArenaString;
+
+
+#endif  // REACTOR_BASE_ARENA_H
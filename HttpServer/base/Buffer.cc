@@ -1,12 +1,11 @@
 #include "Buffer.h"
+#include "BufferPool.h"
 
 #include <sys/uio.h>
 
 
-const char* Buffer::kCRLF = "\r\n";
-
 ssize_t Buffer::readFd(int fd, int* savedErrno) {
-  char extrabuf[65536];
+  char extrabuf[kExtraBufSize];
   struct iovec vec[2];
 
   const size_t writable = writableBytes();
@@ -30,3 +29,27 @@ ssize_t Buffer::readFd(int fd, int* savedErrno) {
   return n;
 }
 
+
+bool Buffer::release(size_t retainAbove) {
+  if (pool_ == nullptr || readableBytes() != 0 || buffer_.empty()) {
+    return false;
+  }
+  if (buffer_.size() > retainAbove) {
+    return true;
+  }
+  pool_->release(&buffer_);
+  readIndex_ = 0;
+  writeIndex_ = 0;
+  return false;
+}
+
+// 换一块更大的存储，至少翻倍，按实际大小分配的大块反复追加时也不会每次都重新分配
+void Buffer::growFromPool(size_t len) {
+  size_t readable = readableBytes();
+  std::vector<char> storage = pool_->acquire(std::max(kCheapPrepend + readable + len, 2 * buffer_.size()));
+  std::copy(beginRead(), static_cast<const char*>(beginWrite()), storage.data() + kCheapPrepend);
+  pool_->release(&buffer_);
+  buffer_.swap(storage);
+  readIndex_ = kCheapPrepend;
+  writeIndex_ = readIndex_ + readable;
+}
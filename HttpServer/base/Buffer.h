@@ -1,23 +1,39 @@
 #ifndef REACTOR_BASE_BUFFER_H
 #define REACTOR_BASE_BUFFER_H
 
+#include "StringSearch.h"
+
 #include <vector>
 #include <assert.h>
+#include <stdint.h>
 #include <string>
 #include <string.h>
 #include <algorithm>
 
+class BufferPool;
+
 
 class Buffer /* copyable */ {
  public:
   static const size_t kCheapPrepend = 8;
   static const size_t kInitialSize = 1024;
+  static const size_t kExtraBufSize = 65536;  // readFd 栈上缓冲的大小
 
   explicit Buffer(size_t initialSize = kInitialSize)
-    : buffer_(kCheapPrepend + initialSize),
+    : pool_(nullptr),
+      buffer_(kCheapPrepend + initialSize),
       readIndex_(kCheapPrepend),
       writeIndex_(kCheapPrepend) {}
 
+  // 存储在写入时才从 pool 借用，数据取完后由 release() 归还，空闲时不占内存
+  // pool 为空时与默认构造相同
+  explicit Buffer(BufferPool* pool)
+    : pool_(pool),
+      buffer_(pool == nullptr ? kCheapPrepend + kInitialSize : 0),
+      readIndex_(pool == nullptr ? kCheapPrepend : 0),
+      writeIndex_(readIndex_) {}
+
+  // 只交换存储，pool 不随之交换
   void swap(Buffer& rhs) {
     buffer_.swap(rhs.buffer_);
     std::swap(readIndex_, rhs.readIndex_);
@@ -27,6 +43,7 @@ class Buffer /* copyable */ {
   size_t readableBytes() const { return writeIndex_ - readIndex_; }
   size_t writableBytes() const { return buffer_.size() - writeIndex_; }
   size_t prependableBytes() const { return readIndex_; }
+  size_t internalCapacity() const { return buffer_.capacity(); }
  
   const char* beginRead() const { return begin() + readIndex_; }
   const char* beginWrite() const { return begin() + writeIndex_; }
@@ -49,8 +66,8 @@ class Buffer /* copyable */ {
   }
 
   void retrieveAll() {
-    readIndex_ = kCheapPrepend;
-    writeIndex_ = kCheapPrepend;
+    readIndex_ = buffer_.empty() ? 0 : kCheapPrepend;  // 已把存储还给 pool 时保持为 0
+    writeIndex_ = readIndex_;
   }
 
   std::string retrieveAsString(size_t len) {
@@ -74,6 +91,10 @@ class Buffer /* copyable */ {
     append(str.c_str(), str.size());
   }
 
+  void append(const char* str) {  // 避免字符串字面量隐式构造 std::string
+    append(str, strlen(str));
+  }
+
   void ensureWritableBytes(size_t len) {
     if (writableBytes() < len) {
       makeSpace(len);
@@ -87,16 +108,42 @@ class Buffer /* copyable */ {
   }
 
   ssize_t readFd(int fd, int* savedErrno);
+  // 没有可读数据时把存储还给 pool，之后的写入再重新借用；未使用 pool 时什么也不做
+  // 存储大于 retainAbove 时先留着（紧接着的大消息不必从头增长）并返回 true，由持有者空闲一段时间后再 release()
+  bool release(size_t retainAbove = SIZE_MAX);
   
   // find \r\n
   const char* findCrlf() const {
-    const char* crlf = std::search(beginRead(), beginWrite(), kCRLF, kCRLF+2);
-    return crlf == beginWrite() ? nullptr : crlf;
+    return findCrlf(beginRead());
+  }
+
+  const char* findCrlf(const char* start) const {
+    assert(beginRead() <= start);
+    assert(start <= beginWrite());
+    return StringSearch::findCrlf(start, beginWrite());
+  }
+
+  // find first \r or \n, used by strict line parsing to reject bare CR/LF
+  const char* findLineBreak(const char* start) const {
+    assert(beginRead() <= start);
+    assert(start <= beginWrite());
+    return StringSearch::findLineBreak(start, beginWrite());
   }
 
   // find \n
   const char* findEol() const {
-    return static_cast<const char*>(memchr(beginRead(), '\n', readableBytes()));
+    return findEol(beginRead());
+  }
+
+  const char* findEol(const char* start) const {
+    return findChar('\n', start);
+  }
+
+  // find c, e.g. ':' and ' ' when tokenizing a header line
+  const char* findChar(char c, const char* start) const {
+    assert(beginRead() <= start);
+    assert(start <= beginWrite());
+    return StringSearch::findChar(start, beginWrite(), c);
   }
 
  private:
@@ -105,6 +152,10 @@ class Buffer /* copyable */ {
 
   void makeSpace(size_t len) {
     if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
+      if (pool_ != nullptr) {
+        growFromPool(len);
+        return;
+      }
       buffer_.resize(writeIndex_ + len);
     }
     else {  // move readable data to front
@@ -118,11 +169,12 @@ class Buffer /* copyable */ {
   }
 
 
+  void growFromPool(size_t len);
+
+  BufferPool* pool_;
   std::vector<char> buffer_;
   size_t readIndex_;
   size_t writeIndex_;
-
-  static const char* kCRLF;
 };
 
 #endif  // REACTOR_BASE_BUFFER_H
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "BufferPool.h"
+
+#include <algorithm>
+
+
+BufferPool::BufferPool()
+  : idleBytes_(0),
+    acquires_(0),
+    hits_(0)
+{
+  for (int c = 0; c < kNumClasses; ++c) {
+    lowWater_[c] = 0;
+  }
+}
+
+BufferPool::~BufferPool() = default;
+
+int BufferPool::sizeClass(size_t size) {
+  for (int c = 0; c < kNumClasses; ++c) {
+    if (size <= classSize(c)) {
+      return c;
+    }
+  }
+  return -1;
+}
+
+std::vector<char> BufferPool::acquire(size_t size) {
+  ++acquires_;
+  int c = sizeClass(size);
+  std::vector<char> storage;
+  if (c >= 0 && !free_[c].empty()) {
+    ++hits_;
+    storage.swap(free_[c].back());
+    free_[c].pop_back();
+    idleBytes_ -= storage.size();
+    lowWater_[c] = std::min(lowWater_[c], free_[c].size());
+  }
+  else {
+    storage.resize(c >= 0 ? classSize(c) : size);
+  }
+  return storage;
+}
+
+void BufferPool::release(std::vector<char>* storage) {
+  size_t size = storage->size();
+  if (size == 0) {
+    return;
+  }
+  int c = sizeClass(size);
+  if (c >= 0 && classSize(c) == size && (free_[c].size() + 1) * size <= kMaxIdleBytesPerClass) {
+    free_[c].emplace_back();
+    free_[c].back().swap(*storage);
+    idleBytes_ += size;
+  }
+  else {  // 按实际大小分配的大块，或这一级已经攒够
+    std::vector<char>().swap(*storage);
+  }
+}
+
+void BufferPool::trim() {
+  for (int c = 0; c < kNumClasses; ++c) {
+    size_t n = std::min(lowWater_[c], free_[c].size());
+    free_[c].erase(free_[c].begin(), free_[c].begin() + n);  // 最早归还的在前面
+    idleBytes_ -= n * classSize(c);
+    lowWater_[c] = free_[c].size();
+  }
+}
@@ -0,0 +1,48 @@
+#ifndef REACTOR_BASE_BUFFERPOOL_H
+#define REACTOR_BASE_BUFFERPOOL_H
+
+#include "noncopyable.h"
+
+#include <stddef.h>
+#include <vector>
+
+
+/*
+  Buffer 存储的按大小分级的空闲链表，每个 EventLoop 一个，只在所属 loop 线程中使用，无需加锁
+  使用 pool 的 Buffer 只在有数据时借用存储，取完数据后由持有者 release() 归还，空闲连接不占缓冲区内存
+  块大小为 1KB、4KB、16KB、64KB、256KB，更大的需求按实际大小分配，归还时直接释放，一次大响应不会让连接一直占着大块内存
+  每级空闲块的总字节数有上限；trim() 释放上次 trim 以来一直没被借出的块，由 EventLoop 定期调用
+*/
+
+class BufferPool : noncopyable {
+ public:
+  static const int kNumClasses = 5;
+  static const size_t kMinBlockSize = 1024;
+  static const size_t kMaxIdleBytesPerClass = 1024 * 1024;
+
+  BufferPool();
+  ~BufferPool();
+
+  // 返回大小不小于 size 的存储（vector 的 size 即可用的字节数）
+  std::vector<char> acquire(size_t size);
+  // 归还存储，*storage 随后为空；大小不属于任何一级的（如交换进来的其他存储）直接释放
+  void release(std::vector<char>* storage);
+  void trim();
+
+  size_t idleBytes() const { return idleBytes_; }
+  size_t acquires() const { return acquires_; }
+  size_t hits() const { return hits_; }
+
+ private:
+  static int sizeClass(size_t size);  // 超过最大一级时返回 -1
+  static size_t classSize(int c) { return kMinBlockSize << (2 * c); }
+
+  std::vector<std::vector<char>> free_[kNumClasses];
+  size_t lowWater_[kNumClasses];  // 上次 trim 以来空闲链表的最小长度
+  size_t idleBytes_;
+  size_t acquires_;
+  size_t hits_;
+};
+
+
+#endif  // REACTOR_BASE_BUFFERPOOL_H
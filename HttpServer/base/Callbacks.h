@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <functional>
+#include "InplaceFunction.h"
 
 using std::placeholders::_1;
 using std::placeholders::_2;
@@ -13,12 +14,13 @@ class Buffer;
 class EventLoop;
 class TcpConnection;
 
-typedef std::function<void()> TimerCallback;
+typedef InplaceFunction<void()> TimerCallback;
 typedef std::function<void(EventLoop*)> ThreadInitCallback;
 typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
 typedef std::function<void(const TcpConnectionPtr&)> ConnectionCallback;
 typedef std::function<void(const TcpConnectionPtr&, Buffer*, Timestamp)> MessageCallback;
 typedef std::function<void(const TcpConnectionPtr&)> WriteCompleteCallback;
+typedef std::function<void(const TcpConnectionPtr&, size_t)> HighWaterMarkCallback;
 typedef std::function<void(const TcpConnectionPtr&)> CloseCallback;
 
 
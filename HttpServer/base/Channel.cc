@@ -4,6 +4,7 @@
 #include "Timestamp.h"
 
 #include <poll.h>
+#include <sys/epoll.h>
 #include <sstream>
 #include <assert.h>
 
@@ -11,6 +12,7 @@
 const int Channel::kNoneEvent = 0;
 const int Channel::kReadEvent = POLLIN | POLLPRI;
 const int Channel::kWriteEvent = POLLOUT;
+const int Channel::kEdgeTriggered = EPOLLET;
 
 Channel::Channel(EventLoop *loop, int fd)
   : loop_(loop),
@@ -18,6 +20,8 @@ Channel::Channel(EventLoop *loop, int fd)
     events_(0),
     revents_(0),
     index_(-1),
+    edgeTriggered_(false),
+    registeredEvents_(0),
     addedToLoop_(false),
     eventHandling_(false),
     tied_(false) {}
@@ -42,8 +46,16 @@ void Channel::handleEvent(Timestamp receiveTime) {
   }
 }
 
+void Channel::setEdgeTriggered(bool on) {
+  assert(!addedToLoop_);
+  edgeTriggered_ = on && loop_->supportsEdgeTriggered();
+}
+
 void Channel::handleEventWithGuard(Timestamp receiveTime) {
   eventHandling_ = true;
+  if (edgeTriggered_) {  // poller 中一直注册着读写事件，只分发当前关注的
+    revents_ &= events_ | ~(kReadEvent | kWriteEvent);
+  }
   if (revents_ & POLLNVAL) {
     LOG_WARN << "Channel::handleEvent() POLLNVAL";
   }
@@ -53,7 +65,8 @@ void Channel::handleEventWithGuard(Timestamp receiveTime) {
   }
 
   if (revents_ & (POLLERR | POLLNVAL)) {
-    if (errorCallback_) errorCallback_();
+    bool queued = (revents_ & POLLERR) && errorQueueCallback_ && errorQueueCallback_();
+    if (!queued && errorCallback_) errorCallback_();
   }
 
   if (revents_ & (POLLIN | POLLPRI | POLLRDHUP)) {
@@ -67,6 +80,11 @@ void Channel::handleEventWithGuard(Timestamp receiveTime) {
 }
 
 void Channel::update() {
+  int registered = events();
+  if (edgeTriggered_ && addedToLoop_ && registered == registeredEvents_) {  // 注册的事件没有变化
+    return;
+  }
+  registeredEvents_ = registered;
   addedToLoop_ = true;
   loop_->updateChannel(this);
 }
@@ -75,10 +93,11 @@ void Channel::remove() {
   assert(isNoneEvent());
   loop_->removeChannel(this);
   addedToLoop_ = false;
+  registeredEvents_ = 0;
 }
 
 std::string Channel::eventsToString() const {
-  return eventsToString(fd_, events_);
+  return eventsToString(fd_, events());
 }
 
 std::string Channel::reventsToString() const {
@@ -103,6 +122,8 @@ std::string Channel::eventsToString(int fd, int ev)
     oss << "ERR ";
   if (ev & POLLNVAL)
     oss << "NVAL ";
+  if (ev & EPOLLET)
+    oss << "ET ";
 
   return oss.str();
 }
@@ -2,6 +2,7 @@
 #define REACTOR_BASE_CHANNEL_H
 
 #include "noncopyable.h"
+#include "InplaceFunction.h"
 
 #include <functional>
 #include <memory>
@@ -11,7 +12,11 @@ class EventLoop;
 
 class Channel : noncopyable {
  public:
-  typedef std::function<void()> EventCallback;
+  typedef InplaceFunction<void()> EventCallback;
+  typedef InplaceFunction<void(Timestamp)> ReadEventCallback;
+  typedef InplaceFunction<bool()> ErrorQueueCallback;
+
+  static const int kEdgeTriggered;  // EPOLLET
 
   Channel(EventLoop *loop, int fd);
   ~Channel();
@@ -19,7 +24,10 @@ class Channel : noncopyable {
   void handleEvent(Timestamp receiveTime);
 
   int fd() const { return fd_; }
-  int events() const { return events_; }
+  // 注册到 poller 的事件，边沿触发时读写事件一直保留
+  int events() const {
+    return edgeTriggered_ && events_ != kNoneEvent ? kReadEvent | kWriteEvent | kEdgeTriggered : events_;
+  }
 
   void set_revents(int revents) { revents_ = revents; }
   bool isNoneEvent() const { return events_ == kNoneEvent; }
@@ -34,10 +42,19 @@ class Channel : noncopyable {
   int index() const { return index_; }
   void set_index(int idx) { index_ = idx; }
 
-  void setReadCallback(std::function<void(Timestamp)> cb) { readCallback_ = std::move(cb); }
+  void setReadCallback(ReadEventCallback cb) { readCallback_ = std::move(cb); }
   void setWriteCallback(EventCallback cb) { writeCallback_ = std::move(cb); }
   void setCloseCallback(EventCallback cb) { closeCallback_ = std::move(cb); }
   void setErrorCallback(EventCallback cb) { errorCallback_ = std::move(cb); }
+  // socket 错误队列中有消息（如 MSG_ZEROCOPY 的完成通知）时 poller 同样报告 POLLERR，先交给该回调读取
+  // 回调返回 false 表示错误队列中没有消息，是真正的错误，再调用 errorCallback_
+  void setErrorQueueCallback(ErrorQueueCallback cb) { errorQueueCallback_ = std::move(cb); }
+
+  // 边沿触发：读写事件注册后一直留在 poller 中，enable/disable 只决定分发哪些事件，不再调用 epoll_ctl
+  // 回调需要读写到 EAGAIN；关闭读期间到达的边沿会被丢弃，重新打开读时由使用者补读一次
+  // 必须在第一次 enable 之前设置，poller 不支持（PollPoller）时忽略
+  void setEdgeTriggered(bool on);
+  bool edgeTriggered() const { return edgeTriggered_; }
 
   void enableReading() { events_ |= kReadEvent; update(); }
   void disableReading() { events_ &= ~kReadEvent; update(); }
@@ -65,15 +82,18 @@ class Channel : noncopyable {
   int events_;
   int revents_;  // it's the received event types of poll
   int index_;  // used by Poller
+  bool edgeTriggered_;
+  int registeredEvents_;  // 上次交给 poller 的 events()
   bool addedToLoop_;
   bool eventHandling_;
   std::weak_ptr<void> tie_;
   bool tied_;
 
-  std::function<void(Timestamp)> readCallback_;
+  ReadEventCallback readCallback_;
   EventCallback writeCallback_;
   EventCallback closeCallback_;
   EventCallback errorCallback_;
+  ErrorQueueCallback errorQueueCallback_;
 };
 
 #endif  // REACTOR_BASE_CHANNEL_H
\ No newline at end of file
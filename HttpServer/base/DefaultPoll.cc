@@ -1,12 +1,32 @@
 #include "Poller.h"
 #include "PollPoller.h"
 #include "EpollPoller.h"
+#ifdef HAVE_IO_URING
+#include "IoUringPoller.h"
+#include "Logging.h"
+
+#include <memory>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
 
 Poller* Poller::newDefaultPoller(EventLoop* loop) {
+#ifdef HAVE_IO_URING
+  // USE_IO_URING=proactor 时同时用 io_uring 完成 socket 读写，其他取值只代替 epoll
+  const char* uring = ::getenv("USE_IO_URING");
+  if (uring != nullptr) {
+    std::unique_ptr<IoUringPoller> poller(new IoUringPoller(loop, strcmp(uring, "proactor") == 0));
+    if (poller->ok()) {
+      return poller.release();
+    }
+    LOG_WARN << "io_uring is not available, fall back to epoll";
+  }
+#endif
   if (::getenv("USE_POLL")) {
     return new PollPoller(loop);
   }
   else {
     return new EpollPoller(loop);
   }
-}
\ No newline at end of file
+}
@@ -13,6 +13,7 @@ class EpollPoller : public Poller {
   Timestamp poll(int timeoutMs, ChannelList* activeChannels) override;
   void updateChannel(Channel* channel) override;
   void removeChannel(Channel* channel) override;
+  bool supportsEdgeTriggered() const override { return true; }
 
  private:
   void fillActiveChannels(int numEvents, ChannelList* activeChannels) const override;
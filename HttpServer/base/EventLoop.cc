@@ -2,6 +2,7 @@
 #include "Logging.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "BufferPool.h"
 #include "Timestamp.h"
 
 #include <stdio.h>
@@ -12,6 +13,7 @@
 
 __thread EventLoop* t_loopInThisThread = nullptr;
 const int kPollTimeMs = 10000;
+const double kBufferPoolTrimInterval = 10.0;
 
 int createEventfd() {
   int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);   // read 会让@para1减1，write 会加1，0读或max写会阻塞或返回EAGAIN
@@ -27,10 +29,14 @@ EventLoop::EventLoop()
     eventHandling_(false),
     threadId_(CurrentThread::tid()),
     poller_(Poller::newDefaultPoller(this)),
+    proactor_(poller_->proactor()),
+    iteration_(0),
+    wakeupPending_(false),
     callingPendingFunctors_(false),
     wakeupFd_(createEventfd()),
     pwakeupChannel_(new Channel(this, wakeupFd_)),
-    timerQueue_(new TimerQueue(this))
+    timerQueue_(new TimerQueue(this)),
+    bufferPool_(new BufferPool)
 {
   LOG_TRACE << "Event Loop created " << this << " in thread " << threadId_;
   if (t_loopInThisThread) {
@@ -42,6 +48,8 @@ EventLoop::EventLoop()
 
   pwakeupChannel_->setReadCallback(std::bind(&EventLoop::handleWakeupRead, this)); // FIXME: here implicitly ignore timeArgs
   pwakeupChannel_->enableReading();
+  BufferPool* pool = bufferPool_.get();
+  runEvery([pool] { pool->trim(); }, kBufferPoolTrimInterval);
 }
 
 EventLoop::~EventLoop() {
@@ -66,6 +74,7 @@ void EventLoop::loop() {
 
   while (!quit_) {
     activeChannels_.clear();
+    ++iteration_;
     Timestamp pollReturnTime =  poller_->poll(kPollTimeMs, &activeChannels_);
     if (Logger::LogLevel() <= Logger::TRACE) {
       printActiveChannels();
@@ -89,27 +98,53 @@ void EventLoop::quit() {
   }
 }
 
-void EventLoop::runInLoop(const Functor& cb) {
+void EventLoop::runInLoop(Functor cb) {
   if (isInLoopThread()) {
     cb();
   }
   else {
-    queueInLoop(cb);
+    queueInLoop(std::move(cb));
   }
 }
 
 void EventLoop::queueInLoop(Functor cb) {
-  {
-    MutexLockGuard lock(mutex_);
-    pendingFunctors_.push_back(std::move(cb));
+  if (isInLoopThread()) {
+    localFunctors_.push_back(std::move(cb));
+    if (callingPendingFunctors_) {
+      wakeup();  // 让eventloop直接在下一次epoll/poll wait中返回
+    }
+  }
+  else {
+    remoteFunctors_.push(std::move(cb));
+    wakeup();
   }
+}
 
-  if (!isInLoopThread() || callingPendingFunctors_) {
-    wakeup();  // 第二个条件可以让eventloop直接在下一次epoll/poll wait中返回，但可能push进去的cb已经swap，以致一次无效唤醒，不过问题不大
+void EventLoop::queueBatchInLoop(std::vector<Functor>* cbs) {
+  if (cbs->empty()) {
+    return;
+  }
+  if (isInLoopThread()) {
+    for (Functor& cb : *cbs) {
+      localFunctors_.push_back(std::move(cb));
+    }
+    cbs->clear();
+    if (callingPendingFunctors_) {
+      wakeup();
+    }
+  }
+  else {
+    remoteFunctors_.pushBatch(cbs);
+    wakeup();
   }
 }
 
+// 多个生产者在同一轮中只有第一个写 eventfd，标志在 doPendingFunctors 取走回调前清除，
+// 此后入队的回调不会被本轮取到，其生产者会看到标志为 false 而再次唤醒
 void EventLoop::wakeup() {
+  if (wakeupPending_.exchange(true)) {
+    return;
+  }
   uint64_t one = 1;
   ssize_t n = write(wakeupFd_, &one, sizeof(one));
   if (n != sizeof(one)) {
@@ -118,18 +153,18 @@ void EventLoop::wakeup() {
 }
 
 void EventLoop::doPendingFunctors() {
-  std::vector<Functor> functors;
+  std::vector<Functor>& functors = runningFunctors_;  // 复用容量，回调中入队的进入 localFunctors_ 留到下一轮
   callingPendingFunctors_ = true;
+  wakeupPending_.store(false);
 
-  {
-    MutexLockGuard lock(mutex_);
-    functors.swap(pendingFunctors_);
-  }
+  functors.swap(localFunctors_);
+  remoteFunctors_.popAll(&functors);
 
   LOG_TRACE << "number of Functors is " << functors.size();
   for (const Functor& functor : functors) {
     functor();
   }
+  functors.clear();
   callingPendingFunctors_ = false;
 }
 
@@ -174,6 +209,10 @@ void EventLoop::removeChannel(Channel* channel) {
   poller_->removeChannel(channel);
 }
 
+bool EventLoop::supportsEdgeTriggered() const {
+  return poller_->supportsEdgeTriggered();
+}
+
 bool EventLoop::hasChannel(Channel* channel) {
   assert(channel->ownerLoop() == this);
   assertInLoopThread();
@@ -5,19 +5,25 @@
 #include "Mutex.h"
 #include "CurrentThread.h"
 #include "TimerQueue.h"
+#include "MpscQueue.h"
+#include "InplaceFunction.h"
 
 #include <unistd.h>
+#include <atomic>
 #include <vector>
 #include <memory>
 #include <functional>
+#include <boost/any.hpp>
 
 
 class Channel;
 class Poller;
+class Proactor;
+class BufferPool;
 
 class EventLoop : noncopyable {
  public:
-  typedef std::function<void()> Functor;
+  typedef InplaceFunction<void()> Functor;  // 只能移动，常见的 bind/lambda 不申请堆内存
 
   EventLoop();
   ~EventLoop();
@@ -26,9 +32,11 @@ class EventLoop : noncopyable {
   void loop();
   void quit();
   
-  void runInLoop(const Functor& cb);
+  void runInLoop(Functor cb);
   void queueInLoop(Functor cb);
-  void wakeup();  // wakeup form poll/epoll wait
+  // 一批回调一次入队，只需一次 CAS 和至多一次唤醒，cbs 随后为空
+  void queueBatchInLoop(std::vector<Functor>* cbs);
+  void wakeup();  // wakeup form poll/epoll wait，已有未处理的唤醒时不再写 eventfd
 
   TimerId runAt(TimerCallback cb, Timestamp when);
   TimerId runAfter(TimerCallback cb, double seconds);
@@ -38,6 +46,12 @@ class EventLoop : noncopyable {
   void updateChannel(Channel* channel);
   void removeChannel(Channel* channel);
   bool hasChannel(Channel* channel);
+  // USE_IO_URING=proactor 且内核支持时非空，socket 的读写和 accept 改为提交给 io_uring，见 Proactor.h
+  Proactor* proactor() const { return proactor_; }
+  bool supportsEdgeTriggered() const;
+  // 本 loop 上连接的缓冲区存储，只能在 loop 线程中使用，空闲块定期释放
+  BufferPool* bufferPool() const { return bufferPool_.get(); }
+  int64_t iteration() const { return iteration_; }
 
   void assertInLoopThread() {
     if (!isInLoopThread()) {
@@ -47,6 +61,10 @@ class EventLoop : noncopyable {
 
   bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
 
+  // per-loop state of the upper layer, destroyed before the poller
+  void setContext(const boost::any& context) { context_ = context; }
+  const boost::any& getContext() const { return context_; }
+
  private:
   void abortNotInLoopThread();
   void printActiveChannels() const;
@@ -58,15 +76,21 @@ class EventLoop : noncopyable {
   bool eventHandling_;
   const pid_t threadId_;
   std::unique_ptr<Poller> poller_;
+  Proactor* proactor_;
+  int64_t iteration_;
   std::vector<Channel*> activeChannels_;
 
-  mutable MutexLock mutex_;
-  std::vector<Functor> pendingFunctors_;  // guarded by mutex_
+  MpscQueue<Functor> remoteFunctors_;    // 其他线程入队，无锁
+  std::vector<Functor> localFunctors_;   // loop 线程自己入队，不需要同步
+  std::vector<Functor> runningFunctors_;
+  std::atomic<bool> wakeupPending_;      // eventfd 已写入、doPendingFunctors 还未开始
   bool callingPendingFunctors_;
   int wakeupFd_;
   std::unique_ptr<Channel> pwakeupChannel_;
   
   std::unique_ptr<TimerQueue> timerQueue_;
+  std::unique_ptr<BufferPool> bufferPool_;
+  boost::any context_;
 };
 
 
@@ -0,0 +1,162 @@
+#ifndef REACTOR_BASE_INPLACEFUNCTION_H
+#define REACTOR_BASE_INPLACEFUNCTION_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+/*
+  只能移动的 std::function 替代品，用于 EventLoop 的回调队列、定时器和 Channel 回调
+  不超过 InlineSize 字节（且移动不抛异常）的可调用对象直接构造在对象内部，不申请堆内存；
+  libstdc++ 的 std::function 只内联 16 字节，std::bind(&Class::method, this, arg) 或捕获 shared_ptr 的 lambda 都要 new
+  更大的对象退回堆上，行为与 std::function 相同
+  默认 InlineSize 使整个对象为 64 字节，可按需要给出更大的值
+*/
+
+const size_t kInplaceFunctionSize = 64 - sizeof(void*);
+
+template <typename Signature, size_t InlineSize = kInplaceFunctionSize>
+class InplaceFunction;
+
+template <typename R, typename... Args, size_t InlineSize>
+class InplaceFunction<R(Args...), InlineSize> {
+ public:
+  InplaceFunction() noexcept : ops_(nullptr) {}
+  InplaceFunction(std::nullptr_t) noexcept : ops_(nullptr) {}
+
+  template <typename F,
+            typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InplaceFunction>::value>::type>
+  InplaceFunction(F&& f) : ops_(nullptr) {
+    typedef typename std::decay<F>::type Fn;
+    if (!isEmpty(f)) {  // 空的函数指针或 std::function 构造出空对象
+      construct<Fn>(std::forward<F>(f), std::integral_constant<bool, kStoredInline<Fn>>());
+    }
+  }
+
+  InplaceFunction(InplaceFunction&& other) noexcept : ops_(other.ops_) {
+    if (ops_ != nullptr) {
+      ops_->move(storage_, other.storage_);
+      other.ops_ = nullptr;
+    }
+  }
+
+  InplaceFunction& operator=(InplaceFunction&& other) noexcept {
+    if (this != &other) {
+      reset();
+      if (other.ops_ != nullptr) {
+        other.ops_->move(storage_, other.storage_);
+        ops_ = other.ops_;
+        other.ops_ = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  InplaceFunction& operator=(std::nullptr_t) noexcept {
+    reset();
+    return *this;
+  }
+
+  template <typename F,
+            typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InplaceFunction>::value>::type>
+  InplaceFunction& operator=(F&& f) {
+    return *this = InplaceFunction(std::forward<F>(f));
+  }
+
+  InplaceFunction(const InplaceFunction&) = delete;
+  InplaceFunction& operator=(const InplaceFunction&) = delete;
+
+  ~InplaceFunction() { reset(); }
+
+  explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+  // 与 std::function 一样，const 对象也可以调用有状态的可调用对象
+  R operator()(Args... args) const {
+    assert(ops_ != nullptr);
+    return ops_->invoke(const_cast<unsigned char*>(storage_), std::forward<Args>(args)...);
+  }
+
+ private:
+  struct Ops {
+    R (*invoke)(void* storage, Args&&... args);
+    void (*move)(void* dst, void* src);  // 移动到 dst 并析构 src
+    void (*destroy)(void* storage);
+  };
+
+  template <typename Fn>
+  static constexpr bool kStoredInline = sizeof(Fn) <= InlineSize
+                                        && alignof(Fn) <= alignof(std::max_align_t)
+                                        && std::is_nothrow_move_constructible<Fn>::value;
+
+  template <typename Fn>
+  struct InlineOps {
+    static R invoke(void* storage, Args&&... args) {
+      return static_cast<R>((*static_cast<Fn*>(storage))(std::forward<Args>(args)...));
+    }
+    static void move(void* dst, void* src) {
+      Fn* from = static_cast<Fn*>(src);
+      ::new (dst) Fn(std::move(*from));
+      from->~Fn();
+    }
+    static void destroy(void* storage) { static_cast<Fn*>(storage)->~Fn(); }
+    static const Ops ops;
+  };
+
+  template <typename Fn>
+  struct HeapOps {
+    static R invoke(void* storage, Args&&... args) {
+      return static_cast<R>((**static_cast<Fn**>(storage))(std::forward<Args>(args)...));
+    }
+    static void move(void* dst, void* src) { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); }
+    static void destroy(void* storage) { delete *static_cast<Fn**>(storage); }
+    static const Ops ops;
+  };
+
+  template <typename F>
+  static bool isEmpty(const F&) { return false; }
+  template <typename T>
+  static bool isEmpty(T* p) { return p == nullptr; }
+  template <typename S>
+  static bool isEmpty(const std::function<S>& f) { return !f; }
+
+  template <typename Fn, typename F>
+  void construct(F&& f, std::true_type /* inline */) {
+    ::new (static_cast<void*>(storage_)) Fn(std::forward<F>(f));
+    ops_ = &InlineOps<Fn>::ops;
+  }
+
+  template <typename Fn, typename F>
+  void construct(F&& f, std::false_type /* inline */) {
+    *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(f));
+    ops_ = &HeapOps<Fn>::ops;
+  }
+
+  void reset() noexcept {
+    if (ops_ != nullptr) {
+      ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+  }
+
+  static_assert(InlineSize >= sizeof(void*), "InlineSize must be able to hold a pointer");
+
+  alignas(std::max_align_t) unsigned char storage_[InlineSize];
+  const Ops* ops_;
+};
+
+template <typename R, typename... Args, size_t InlineSize>
+template <typename Fn>
+const typename InplaceFunction<R(Args...), InlineSize>::Ops
+InplaceFunction<R(Args...), InlineSize>::InlineOps<Fn>::ops = { &invoke, &move, &destroy };
+
+template <typename R, typename... Args, size_t InlineSize>
+template <typename Fn>
+const typename InplaceFunction<R(Args...), InlineSize>::Ops
+InplaceFunction<R(Args...), InlineSize>::HeapOps<Fn>::ops = { &invoke, &move, &destroy };
+
+#endif  // REACTOR_BASE_INPLACEFUNCTION_H
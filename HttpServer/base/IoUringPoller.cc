@@ -0,0 +1,705 @@
+#include "IoUringPoller.h"
+#include "Logging.h"
+#include "Channel.h"
+#include "Timestamp.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <linux/io_uring.h>
+#include <algorithm>
+
+// 没有 liburing，直接用系统调用操作 ring
+
+namespace
+{
+
+const int kNew = -1;
+const int kAdded = 1;
+
+// user_data 的最高字节为操作类型，kIgnore 用于撤销请求本身
+enum OpKind { kIgnore = 0, kPollOp, kRecvOp, kSendOp, kAcceptOp };
+const uint32_t kGenMask = 0xffffff;
+const uint16_t kBufferGroup = 0;
+
+inline uint64_t userData(OpKind kind, uint32_t gen, int fd) {
+  return static_cast<uint64_t>(kind) << 56 | static_cast<uint64_t>(gen) << 32 | static_cast<uint32_t>(fd);
+}
+
+// multishot recv 需要 6.0 以后的内核，provided buffer ring 注册成功只能说明 5.19
+bool kernelAtLeast(int major, int minor) {
+  struct utsname u;
+  int ma = 0, mi = 0;
+  if (::uname(&u) < 0 || sscanf(u.release, "%d.%d", &ma, &mi) != 2) {
+    return false;
+  }
+  return ma > major || (ma == major && mi >= minor);
+}
+
+template <typename T>
+inline T* ringField(void* ring, uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+} // namespace
+
+
+IoUringPoller::IoUringPoller(EventLoop* loop, bool proactor)
+  : Poller(loop),
+    ringFd_(-1),
+    features_(0),
+    multishotPoll_(false),
+    sqRing_(MAP_FAILED),
+    sqRingSize_(0),
+    cqRing_(MAP_FAILED),
+    cqRingSize_(0),
+    sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+    sqesSize_(0),
+    sqHead_(nullptr),
+    sqTail_(nullptr),
+    sqMask_(0),
+    sqEntries_(0),
+    sqLocalTail_(0),
+    toSubmit_(0),
+    cqHead_(nullptr),
+    cqTail_(nullptr),
+    cqMask_(0),
+    cqes_(nullptr),
+    bufRing_(nullptr),
+    bufBase_(nullptr),
+    bufTail_(0),
+    nextGen_(1) {
+  // EventLoop 在自己的线程中构造，ring 只由这个线程提交；老内核不认识这些标志时去掉重试
+  if (!setupRing(kRingEntries, IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN)
+      && !setupRing(kRingEntries, 0)) {
+    LOG_SYSERR << "IoUringPoller::IoUringPoller";
+    return;
+  }
+  // 6.0 以前的 multishot poll 是水平触发的，对一直注册的 POLLOUT 会不停返回
+  multishotPoll_ = kernelAtLeast(6, 0);
+  if (proactor && !setupBufferRing()) {
+    LOG_WARN << "io_uring proactor is not supported by this kernel, use io_uring for polling only";
+  }
+}
+
+IoUringPoller::~IoUringPoller() {
+  for (auto& socket : sockets_) {  // 没取走的新连接
+    if (socket) {
+      for (int fd : socket->accepted) {
+        ::close(fd);
+      }
+    }
+  }
+  if (bufRing_ != nullptr) {  // 随 ring fd 关闭自动注销
+    ::munmap(bufRing_, kBufferCount * sizeof(struct io_uring_buf));
+    ::munmap(bufBase_, kBufferCount * kBufferSize);
+  }
+  if (sqes_ != MAP_FAILED) {
+    ::munmap(sqes_, sqesSize_);
+  }
+  if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+    ::munmap(cqRing_, cqRingSize_);
+  }
+  if (sqRing_ != MAP_FAILED) {
+    ::munmap(sqRing_, sqRingSize_);
+  }
+  if (ringFd_ >= 0) {
+    ::close(ringFd_);
+  }
+}
+
+bool IoUringPoller::setupRing(unsigned entries, unsigned flags) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  p.flags = flags | IORING_SETUP_CQSIZE;
+  p.cq_entries = kCompletionEntries;
+  int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+  if (fd < 0) {
+    return false;
+  }
+  // 需要带超时的等待（5.11）和不丢弃完成事件
+  if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+    ::close(fd);
+    errno = ENOSYS;
+    return false;
+  }
+
+  sqRingSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cqRingSize_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  bool singleMmap = p.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMmap) {
+    sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+  }
+  sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sqRing_ != MAP_FAILED) {
+    cqRing_ = singleMmap ? sqRing_
+                         : ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                  fd, IORING_OFF_CQ_RING);
+  }
+  if (cqRing_ != MAP_FAILED) {
+    sqesSize_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe*>(::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                                                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+  }
+  ringFd_ = fd;  // 由析构函数回收
+  if (sqes_ == MAP_FAILED) {
+    return false;
+  }
+
+  features_ = p.features;
+  sqHead_ = ringField<unsigned>(sqRing_, p.sq_off.head);
+  sqTail_ = ringField<unsigned>(sqRing_, p.sq_off.tail);
+  sqMask_ = *ringField<unsigned>(sqRing_, p.sq_off.ring_mask);
+  sqEntries_ = p.sq_entries;
+  sqLocalTail_ = *sqTail_;
+  unsigned* array = ringField<unsigned>(sqRing_, p.sq_off.array);
+  for (unsigned i = 0; i < sqEntries_; ++i) {  // SQE 按顺序使用，索引数组固定为恒等映射
+    array[i] = i;
+  }
+
+  cqHead_ = ringField<unsigned>(cqRing_, p.cq_off.head);
+  cqTail_ = ringField<unsigned>(cqRing_, p.cq_off.tail);
+  cqMask_ = *ringField<unsigned>(cqRing_, p.cq_off.ring_mask);
+  cqes_ = ringField<struct io_uring_cqe>(cqRing_, p.cq_off.cqes);
+  LOG_INFO << "IoUringPoller: sq entries = " << p.sq_entries << ", cq entries = " << p.cq_entries
+           << ", flags = " << flags;
+  return true;
+}
+
+bool IoUringPoller::setupBufferRing() {
+  if (!kernelAtLeast(6, 0)) {
+    return false;
+  }
+  size_t ringBytes = kBufferCount * sizeof(struct io_uring_buf);
+  void* ring = ::mmap(nullptr, ringBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  void* base = ::mmap(nullptr, kBufferCount * kBufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+  reg.ring_entries = kBufferCount;
+  reg.bgid = kBufferGroup;
+  if (ring == MAP_FAILED || base == MAP_FAILED
+      || ::syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    LOG_SYSERR << "IoUringPoller::setupBufferRing()";
+    if (ring != MAP_FAILED) {
+      ::munmap(ring, ringBytes);
+    }
+    if (base != MAP_FAILED) {
+      ::munmap(base, kBufferCount * kBufferSize);
+    }
+    return false;
+  }
+
+  bufRing_ = static_cast<struct io_uring_buf_ring*>(ring);
+  bufBase_ = static_cast<char*>(base);
+  for (unsigned bid = 0; bid < kBufferCount; ++bid) {
+    recycleBuffer(bid);
+  }
+  __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+  LOG_INFO << "IoUringPoller: proactor enabled, " << kBufferCount << " x " << kBufferSize << " bytes recv buffers";
+  return true;
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList* activeChannels) {
+  LOG_TRACE << "fd total count: " << channels_.size();
+  rearm();
+
+  int ret = enter(1, timeoutMs);
+  int savedErrno = errno;
+  Timestamp now = Timestamp::now();
+  int numEvents = reapCompletions();
+  if (numEvents > 0) {
+    LOG_TRACE << numEvents << " events happened";
+    fillActiveChannels(numEvents, activeChannels);
+    for (int fd : active_) {
+      states_[fd].revents = 0;
+    }
+  }
+  else if (ret >= 0 || savedErrno == ETIME) {
+    LOG_TRACE << "nothing happended";
+  }
+  else if (savedErrno != EINTR) {
+    errno = savedErrno;
+    LOG_SYSERR << "IoUringPoller::poll()";
+  }
+  return now;
+}
+
+void IoUringPoller::fillActiveChannels(int numEvents, ChannelList* activeChannels) const {
+  assert(static_cast<size_t>(numEvents) <= active_.size());
+  for (int i = 0; i < numEvents; ++i) {
+    int fd = active_[i];
+    auto it = channels_.find(fd);
+    assert(it != channels_.end());
+
+    Channel* channel = it->second;
+    channel->set_revents(states_[fd].revents);
+    activeChannels->push_back(channel);
+  }
+}
+
+void IoUringPoller::updateChannel(Channel* channel) {
+  assertInLoopThread();
+  registerChannel(channel);
+  LOG_TRACE << "fd = " << channel->fd() << ", events = { " << channel->eventsToString() << " }";
+
+  FdState& state = stateOf(channel->fd());
+  if (state.pollGen != 0) {
+    if (state.pollEvents == static_cast<uint32_t>(channel->events())) {
+      return;
+    }
+    cancelPoll(channel->fd());
+  }
+  if (!channel->isNoneEvent()) {
+    armPoll(channel);
+  }
+}
+
+void IoUringPoller::removeChannel(Channel* channel) {
+  assertInLoopThread();
+  int fd = channel->fd();
+  assert(channels_.find(fd) != channels_.end());
+  assert(channels_[fd] == channel);
+  assert(channel->isNoneEvent());
+  assert(channel->index() == kAdded);
+
+  size_t n = channels_.erase(fd);
+  (void)n;
+  assert(n == 1);
+  if (states_[fd].pollGen != 0) {
+    cancelPoll(fd);
+  }
+
+  SocketState* socket = socketOf(fd);
+  if (socket != nullptr) {
+    // 撤销未完成的操作，之后到达的完成事件 gen 不匹配，fd 被新连接复用也不受影响
+    if (socket->recvGen != 0) {
+      cancelOp(userData(kRecvOp, socket->recvGen, fd));
+    }
+    if (socket->acceptGen != 0) {
+      cancelOp(userData(kAcceptOp, socket->acceptGen, fd));
+    }
+    if (socket->sendGen != 0) {  // 内核可能还在读这块内存
+      uint64_t data = userData(kSendOp, socket->sendGen, fd);
+      cancelOp(data);
+      retiredSends_[data].swap(socket->sending);
+    }
+    for (int connfd : socket->accepted) {
+      ::close(connfd);
+    }
+    SocketState reset;
+    reset.sending.swap(socket->sending);
+    reset.sending.retrieveAll();
+    reset.accepted.swap(socket->accepted);
+    reset.accepted.clear();
+    *socket = std::move(reset);
+  }
+  channel->set_index(kNew);
+}
+
+void IoUringPoller::startRecv(Channel* channel, Buffer* input) {
+  assertInLoopThread();
+  registerChannel(channel);
+  SocketState* socket = socketFor(channel);
+  socket->input = input;
+  socket->recvWanted = true;
+  if (socket->recvGen == 0 && !socket->eof && socket->recvErr == 0) {
+    armRecv(channel->fd(), socket);
+  }
+}
+
+void IoUringPoller::stopRecv(Channel* channel) {
+  assertInLoopThread();
+  SocketState* socket = socketFor(channel);
+  socket->recvWanted = false;
+  if (socket->recvGen != 0) {  // 撤销前已收到的数据照常追加到 input
+    cancelOp(userData(kRecvOp, socket->recvGen, channel->fd()));
+  }
+}
+
+bool IoUringPoller::receiving(Channel* channel) const {
+  SocketState* socket = socketOf(channel->fd());
+  return socket != nullptr && socket->recvWanted;
+}
+
+size_t IoUringPoller::takeReceived(Channel* channel, bool* eof, int* err) {
+  SocketState* socket = socketFor(channel);
+  size_t n = socket->received;
+  socket->received = 0;
+  *eof = socket->eof;
+  *err = socket->recvErr;
+  return n;
+}
+
+void IoUringPoller::send(Channel* channel, Buffer* data) {
+  assertInLoopThread();
+  registerChannel(channel);
+  SocketState* socket = socketFor(channel);
+  assert(socket->sendGen == 0);
+  assert(socket->sending.readableBytes() == 0);
+  socket->sending.swap(*data);
+  armSend(channel->fd(), socket);
+}
+
+bool IoUringPoller::sending(Channel* channel) const {
+  SocketState* socket = socketOf(channel->fd());
+  return socket != nullptr && socket->sendGen != 0;
+}
+
+size_t IoUringPoller::sendingBytes(Channel* channel) const {
+  SocketState* socket = socketOf(channel->fd());
+  return socket != nullptr && socket->sendGen != 0 ? socket->sending.readableBytes() : 0;
+}
+
+bool IoUringPoller::takeSendResult(Channel* channel, int* err) {
+  SocketState* socket = socketFor(channel);
+  if (!socket->sendDone) {
+    return false;
+  }
+  socket->sendDone = false;
+  *err = socket->sendErr;
+  socket->sendErr = 0;
+  return true;
+}
+
+void IoUringPoller::startAccept(Channel* channel) {
+  assertInLoopThread();
+  registerChannel(channel);
+  SocketState* socket = socketFor(channel);
+  socket->acceptWanted = true;
+  if (socket->acceptGen == 0) {
+    armAccept(channel->fd(), socket);
+  }
+}
+
+void IoUringPoller::takeAccepted(Channel* channel, std::vector<int>* fds, int* err) {
+  SocketState* socket = socketFor(channel);
+  fds->insert(fds->end(), socket->accepted.begin(), socket->accepted.end());
+  socket->accepted.clear();
+  *err = socket->acceptErr;
+  socket->acceptErr = 0;
+}
+
+struct io_uring_sqe* IoUringPoller::getSqe() {
+  if (sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) == sqEntries_) {
+    // 一轮中改动太多，先提交腾出位置
+    if (enter(0, 0) < 0 || sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) == sqEntries_) {
+      LOG_SYSFATAL << "IoUringPoller::getSqe(), submission queue full";
+    }
+  }
+  struct io_uring_sqe* sqe = &sqes_[sqLocalTail_ & sqMask_];
+  memset(sqe, 0, sizeof(*sqe));
+  ++sqLocalTail_;
+  ++toSubmit_;
+  return sqe;
+}
+
+int IoUringPoller::enter(unsigned waitNr, int timeoutMs) {
+  __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+
+  unsigned flags = 0;
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  memset(&arg, 0, sizeof(arg));
+  if (waitNr > 0) {
+    flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeoutMs >= 0) {
+      ts.tv_sec = timeoutMs / 1000;
+      ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+      arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+  }
+  int ret = static_cast<int>(::syscall(__NR_io_uring_enter, ringFd_, toSubmit_, waitNr, flags,
+                                       waitNr > 0 ? &arg : nullptr, waitNr > 0 ? sizeof(arg) : 0));
+  if (ret > 0) {  // 返回值为提交的 SQE 个数
+    toSubmit_ -= static_cast<unsigned>(ret);
+  }
+  return ret;
+}
+
+uint32_t IoUringPoller::newGen() {
+  uint32_t gen = nextGen_;
+  nextGen_ = (nextGen_ + 1) & kGenMask;
+  if (nextGen_ == 0) {
+    nextGen_ = 1;
+  }
+  return gen;
+}
+
+void IoUringPoller::registerChannel(Channel* channel) {
+  int fd = channel->fd();
+  if (channel->index() == kNew) {
+    assert(channels_.find(fd) == channels_.end());
+    channels_[fd] = channel;
+    channel->set_index(kAdded);
+  }
+  else {
+    assert(channels_.find(fd) != channels_.end());
+    assert(channels_[fd] == channel);
+  }
+  stateOf(fd);
+}
+
+void IoUringPoller::armPoll(Channel* channel) {
+  int fd = channel->fd();
+  uint32_t gen = newGen();
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = static_cast<uint32_t>(channel->events() & ~Channel::kEdgeTriggered);
+  if (channel->edgeTriggered()) {  // multishot poll 默认就是边沿触发
+    sqe->len = IORING_POLL_ADD_MULTI;
+  }
+  sqe->user_data = userData(kPollOp, gen, fd);
+  states_[fd].pollGen = gen;
+  states_[fd].pollEvents = static_cast<uint32_t>(channel->events());
+}
+
+void IoUringPoller::cancelPoll(int fd) {
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = userData(kPollOp, states_[fd].pollGen, fd);
+  sqe->user_data = userData(kIgnore, 0, 0);
+  if (features_ & IORING_FEAT_CQE_SKIP) {
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  }
+  states_[fd].pollGen = 0;
+}
+
+void IoUringPoller::armRecv(int fd, SocketState* socket) {
+  socket->recvGen = newGen();
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kBufferGroup;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->user_data = userData(kRecvOp, socket->recvGen, fd);
+}
+
+void IoUringPoller::armSend(int fd, SocketState* socket) {
+  socket->sendGen = newGen();
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(socket->sending.beginRead());
+  sqe->len = static_cast<uint32_t>(std::min<size_t>(socket->sending.readableBytes(), 1u << 30));
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = userData(kSendOp, socket->sendGen, fd);
+}
+
+void IoUringPoller::armAccept(int fd, SocketState* socket) {
+  socket->acceptGen = newGen();
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = fd;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->user_data = userData(kAcceptOp, socket->acceptGen, fd);
+}
+
+void IoUringPoller::cancelOp(uint64_t target) {
+  struct io_uring_sqe* sqe = getSqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = target;
+  sqe->user_data = userData(kIgnore, 0, 0);
+  if (features_ & IORING_FEAT_CQE_SKIP) {
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  }
+}
+
+// 一次性的 poll 请求在触发后失效，重新挂上时内核会再检查一次就绪状态，语义与 EpollPoller 的水平触发相同
+// multishot 的 recv/accept 在出错或 provided buffer 用完（ENOBUFS）时结束，仍需要时重新提交
+void IoUringPoller::rearm() {
+  for (int fd : rearm_) {
+    auto it = channels_.find(fd);
+    if (it == channels_.end()) {
+      continue;
+    }
+    Channel* channel = it->second;
+    if (states_[fd].pollGen == 0 && !channel->isNoneEvent()) {
+      armPoll(channel);
+    }
+    SocketState* socket = socketOf(fd);
+    if (socket != nullptr) {
+      if (socket->recvWanted && socket->recvGen == 0 && !socket->eof && socket->recvErr == 0) {
+        armRecv(fd, socket);
+      }
+      if (socket->acceptWanted && socket->acceptGen == 0) {
+        armAccept(fd, socket);
+      }
+    }
+  }
+  rearm_.clear();
+}
+
+int IoUringPoller::reapCompletions() {
+  active_.clear();
+  unsigned head = *cqHead_;
+  unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+  uint16_t oldBufTail = bufTail_;
+  for (; head != tail; ++head) {
+    const struct io_uring_cqe& cqe = cqes_[head & cqMask_];
+    OpKind kind = static_cast<OpKind>(cqe.user_data >> 56);
+    uint32_t gen = static_cast<uint32_t>(cqe.user_data >> 32) & kGenMask;
+    int fd = static_cast<int>(static_cast<uint32_t>(cqe.user_data));
+    switch (kind) {
+      case kPollOp:
+        if (static_cast<size_t>(fd) < states_.size() && states_[fd].pollGen == gen) {
+          if (!(cqe.flags & IORING_CQE_F_MORE)) {  // 一次性 poll，或 multishot poll 被内核结束
+            states_[fd].pollGen = 0;
+            rearm_.push_back(fd);
+          }
+          activate(fd, cqe.res >= 0 ? cqe.res : POLLERR);
+        }
+        break;
+      case kRecvOp:
+        completeRecv(fd, gen, cqe);
+        break;
+      case kSendOp:
+        completeSend(cqe.user_data, fd, gen, cqe.res);
+        break;
+      case kAcceptOp:
+        completeAccept(fd, gen, cqe);
+        break;
+      default:  // 撤销请求的结果，目标已经完成时为 ENOENT/EALREADY
+        if (cqe.res < 0 && cqe.res != -ENOENT && cqe.res != -EALREADY) {
+          errno = -cqe.res;
+          LOG_SYSERR << "IoUringPoller::reapCompletions(), cancel";
+        }
+        break;
+    }
+  }
+  __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+  if (bufTail_ != oldBufTail) {
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+  }
+  return static_cast<int>(active_.size());
+}
+
+void IoUringPoller::completeRecv(int fd, uint32_t gen, const struct io_uring_cqe& cqe) {
+  SocketState* socket = socketOf(fd);
+  bool current = socket != nullptr && socket->recvGen == gen && socket->input != nullptr;
+  if (cqe.flags & IORING_CQE_F_BUFFER) {
+    unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+    if (current && cqe.res > 0) {
+      socket->input->append(bufBase_ + bid * kBufferSize, cqe.res);
+      socket->received += cqe.res;
+    }
+    recycleBuffer(bid);
+  }
+  if (!current) {
+    return;
+  }
+
+  if (cqe.res == 0) {
+    socket->eof = true;
+  }
+  else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+    socket->recvErr = -cqe.res;
+  }
+  if (!(cqe.flags & IORING_CQE_F_MORE)) {
+    socket->recvGen = 0;
+    rearm_.push_back(fd);
+  }
+  if (cqe.res >= 0 || socket->recvErr != 0) {
+    activate(fd, POLLIN);
+  }
+}
+
+void IoUringPoller::completeSend(uint64_t data, int fd, uint32_t gen, int res) {
+  SocketState* socket = socketOf(fd);
+  if (socket == nullptr || socket->sendGen != gen) {
+    retiredSends_.erase(data);
+    return;
+  }
+
+  if (res > 0) {
+    socket->sending.retrieve(res);
+  }
+  if ((res >= 0 || res == -EAGAIN || res == -EINTR) && socket->sending.readableBytes() > 0) {
+    armSend(fd, socket);  // 只发出了一部分
+    return;
+  }
+  if (res < 0) {
+    socket->sendErr = -res;
+    socket->sending.retrieveAll();
+  }
+  socket->sendGen = 0;
+  socket->sendDone = true;
+  activate(fd, POLLOUT);
+}
+
+void IoUringPoller::completeAccept(int fd, uint32_t gen, const struct io_uring_cqe& cqe) {
+  SocketState* socket = socketOf(fd);
+  if (socket == nullptr || socket->acceptGen != gen) {
+    if (cqe.res >= 0) {
+      ::close(cqe.res);
+    }
+    return;
+  }
+
+  if (cqe.res >= 0) {
+    socket->accepted.push_back(cqe.res);
+  }
+  else if (cqe.res != -ECANCELED) {
+    socket->acceptErr = -cqe.res;
+  }
+  if (!(cqe.flags & IORING_CQE_F_MORE)) {
+    socket->acceptGen = 0;
+    rearm_.push_back(fd);
+  }
+  if (cqe.res >= 0 || socket->acceptErr != 0) {
+    activate(fd, POLLIN);
+  }
+}
+
+void IoUringPoller::recycleBuffer(unsigned bid) {
+  // ring 本身就是 io_uring_buf 数组（tail 占用第一项的 resv），C++ 下头文件中 bufs 的偏移不对，不能用
+  struct io_uring_buf* buf = reinterpret_cast<struct io_uring_buf*>(bufRing_) + (bufTail_ & (kBufferCount - 1));
+  buf->addr = reinterpret_cast<uint64_t>(bufBase_ + bid * kBufferSize);
+  buf->len = kBufferSize;
+  buf->bid = static_cast<uint16_t>(bid);
+  ++bufTail_;
+}
+
+void IoUringPoller::activate(int fd, int revents) {
+  FdState& state = states_[fd];
+  if (state.revents == 0) {
+    active_.push_back(fd);
+  }
+  state.revents |= revents;
+}
+
+IoUringPoller::FdState& IoUringPoller::stateOf(int fd) {
+  if (static_cast<size_t>(fd) >= states_.size()) {
+    states_.resize(fd + 1, FdState{ 0, 0, 0 });
+  }
+  return states_[fd];
+}
+
+IoUringPoller::SocketState* IoUringPoller::socketOf(int fd) const {
+  return static_cast<size_t>(fd) < sockets_.size() ? sockets_[fd].get() : nullptr;
+}
+
+IoUringPoller::SocketState* IoUringPoller::socketFor(Channel* channel) {
+  int fd = channel->fd();
+  if (static_cast<size_t>(fd) >= sockets_.size()) {
+    sockets_.resize(fd + 1);
+  }
+  if (!sockets_[fd]) {
+    sockets_[fd].reset(new SocketState);
+  }
+  return sockets_[fd].get();
+}
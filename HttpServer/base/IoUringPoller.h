@@ -0,0 +1,144 @@
+#ifndef REACTOR_BASE_IOURINGPOLLER_H
+#define REACTOR_BASE_IOURINGPOLLER_H
+
+#include "Poller.h"
+#include "Proactor.h"
+#include "Buffer.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+/*
+  用 io_uring 的 IORING_OP_POLL_ADD 实现的 Poller
+  updateChannel/removeChannel 只填写 SQE，不进入内核，所有改动和等待在 poll() 中由一次 io_uring_enter 完成，
+  省去 EpollPoller 每次改动的 epoll_ctl
+  proactor 为 true 时同时提供 Proactor 接口：socket 的 recv/send/accept 直接作为 io_uring 操作提交，
+  recv 使用注册给内核的 provided buffer ring，代替 Buffer::readFd 栈上的 extrabuf
+  内核不支持 io_uring 时 ok() 为 false，由 newDefaultPoller 退回 EpollPoller；不支持 proactor 所需特性时只作为 Poller
+*/
+
+class IoUringPoller : public Poller, public Proactor {
+ public:
+  IoUringPoller(EventLoop* loop, bool proactor);
+  ~IoUringPoller() override;
+
+  bool ok() const { return ringFd_ >= 0; }
+  Proactor* proactor() override { return bufRing_ != nullptr ? this : nullptr; }
+  bool supportsEdgeTriggered() const override { return multishotPoll_; }
+
+  Timestamp poll(int timeoutMs, ChannelList* activeChannels) override;
+  void updateChannel(Channel* channel) override;
+  void removeChannel(Channel* channel) override;
+
+  void startRecv(Channel* channel, Buffer* input) override;
+  void stopRecv(Channel* channel) override;
+  bool receiving(Channel* channel) const override;
+  size_t takeReceived(Channel* channel, bool* eof, int* err) override;
+  void send(Channel* channel, Buffer* data) override;
+  bool sending(Channel* channel) const override;
+  size_t sendingBytes(Channel* channel) const override;
+  bool takeSendResult(Channel* channel, int* err) override;
+  void startAccept(Channel* channel) override;
+  void takeAccepted(Channel* channel, std::vector<int>* fds, int* err) override;
+
+ private:
+  // 每个 fd 挂在 ring 上的请求，gen 为 0 表示没有
+  // user_data 由操作类型、gen 和 fd 组成，gen 不匹配的完成事件来自已撤销的请求（fd 可能已被复用），直接丢弃
+  struct FdState {
+    uint32_t pollGen;
+    uint32_t pollEvents;
+    int revents;  // 本轮要交给 channel 的事件
+  };
+
+  // proactor 模式下 socket 的操作状态，按 fd 复用
+  struct SocketState {
+    Buffer* input = nullptr;
+    uint32_t recvGen = 0;
+    bool recvWanted = false;
+    bool eof = false;
+    int recvErr = 0;
+    size_t received = 0;
+
+    uint32_t sendGen = 0;
+    Buffer sending;  // 内核发送期间不能移动，send 完成前由 poller 持有
+    bool sendDone = false;
+    int sendErr = 0;
+
+    uint32_t acceptGen = 0;
+    bool acceptWanted = false;
+    std::vector<int> accepted;
+    int acceptErr = 0;
+  };
+
+  void fillActiveChannels(int numEvents, ChannelList* activeChannels) const override;
+  bool setupRing(unsigned entries, unsigned flags);
+  bool setupBufferRing();
+  struct io_uring_sqe* getSqe();
+  int enter(unsigned waitNr, int timeoutMs);
+  uint32_t newGen();
+  void registerChannel(Channel* channel);
+  void armPoll(Channel* channel);
+  void cancelPoll(int fd);
+  void armRecv(int fd, SocketState* socket);
+  void armSend(int fd, SocketState* socket);
+  void armAccept(int fd, SocketState* socket);
+  void cancelOp(uint64_t userData);
+  void rearm();
+  int reapCompletions();
+  void completeRecv(int fd, uint32_t gen, const struct io_uring_cqe& cqe);
+  void completeSend(uint64_t userData, int fd, uint32_t gen, int res);
+  void completeAccept(int fd, uint32_t gen, const struct io_uring_cqe& cqe);
+  void recycleBuffer(unsigned bid);
+  void activate(int fd, int revents);
+  FdState& stateOf(int fd);
+  SocketState* socketOf(int fd) const;
+  SocketState* socketFor(Channel* channel);
+
+  static const unsigned kRingEntries = 256;
+  static const unsigned kCompletionEntries = 4096;
+  static const unsigned kBufferCount = 64;       // provided buffer 个数，2 的幂
+  static const unsigned kBufferSize = 16 * 1024;
+
+  int ringFd_;
+  unsigned features_;
+  bool multishotPoll_;  // 边沿触发的 channel 使用 multishot poll，一直挂在 ring 上
+
+  void* sqRing_;
+  size_t sqRingSize_;
+  void* cqRing_;
+  size_t cqRingSize_;
+  struct io_uring_sqe* sqes_;
+  size_t sqesSize_;
+
+  unsigned* sqHead_;
+  unsigned* sqTail_;
+  unsigned sqMask_;
+  unsigned sqEntries_;
+  unsigned sqLocalTail_;
+  unsigned toSubmit_;
+
+  unsigned* cqHead_;
+  unsigned* cqTail_;
+  unsigned cqMask_;
+  struct io_uring_cqe* cqes_;
+
+  struct io_uring_buf_ring* bufRing_;  // proactor 模式下非空
+  char* bufBase_;
+  uint16_t bufTail_;
+
+  uint32_t nextGen_;
+  std::vector<FdState> states_;  // 以 fd 为下标
+  std::vector<std::unique_ptr<SocketState>> sockets_;  // 以 fd 为下标
+  std::map<uint64_t, Buffer> retiredSends_;  // 连接注销时仍在发送的数据，等完成事件到达后释放
+  std::vector<int> rearm_;   // 一次性 poll 已触发或 multishot 请求已结束的 fd，下一轮等待前重新挂上
+  std::vector<int> active_;  // 本轮有事件的 fd
+};
+
+#endif  // REACTOR_BASE_IOURINGPOLLER_H
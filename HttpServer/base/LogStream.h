@@ -5,6 +5,7 @@
 
 #include <string.h>
 #include <string>
+#include <boost/utility/string_view.hpp>
 
 const int kSmallBuffer = 4000;
 const int kLargeBuffer = 4000*1000;
@@ -91,6 +92,11 @@ class LogStream : noncopyable {
     return *this;
   }
 
+  LogStream& operator<<(boost::string_view v) {
+    buffer_.append(v.data(), v.size());
+    return *this;
+  }
+
  private:
   template<typename T>
   void formatInteger(T);
@@ -0,0 +1,155 @@
+#ifndef REACTOR_BASE_MPSCQUEUE_H
+#define REACTOR_BASE_MPSCQUEUE_H
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include <utility>
+
+
+/*
+  多生产者单消费者的无锁队列，生产者把节点 CAS 到单链表（栈）头部，消费者一次 exchange 取走整条链再反转成 FIFO
+  消费者总是取走全部节点，不会出现 ABA；pushBatch 先在本地串好一条链，只需一次 CAS
+  同一生产者的元素保持先后顺序，不同生产者之间按 CAS 成功的先后
+  节点循环使用：消费者把取空的节点（每次最多 kMaxRecycled 个）串回 free_，生产者本线程的缓存用完时
+  一次 exchange 取走 free_ 上的整条链；free_ 只有整条取走和整条压入两种操作，同样没有 ABA
+  稳定状态下 push 不申请内存，缓存按 T 在线程内共享（各 EventLoop 的队列节点相同），线程退出时释放
+*/
+
+template <typename T>
+class MpscQueue : noncopyable {
+ public:
+  MpscQueue() : head_(nullptr), free_(nullptr) {}
+
+  ~MpscQueue() {
+    Node* node = head_.load(std::memory_order_acquire);
+    while (node != nullptr) {
+      Node* next = node->next;
+      node->value()->~T();
+      delete node;
+      node = next;
+    }
+    deleteChain(free_.load(std::memory_order_acquire));
+  }
+
+  void push(T value) {
+    Node* node = allocate(std::move(value));
+    link(&head_, node, node);
+  }
+
+  // values 中的元素按顺序入队，values 随后为空
+  void pushBatch(std::vector<T>* values) {
+    if (values->empty()) {
+      return;
+    }
+    Node* oldest = nullptr;
+    Node* newest = nullptr;
+    for (T& value : *values) {  // 与逐个 push 相同，链表头为最新的元素
+      Node* node = allocate(std::move(value));
+      if (oldest == nullptr) {
+        oldest = node;
+      }
+      node->next = newest;
+      newest = node;
+    }
+    values->clear();
+    link(&head_, oldest, newest);
+  }
+
+  // 只能由消费者调用，按入队顺序追加到 out，返回取出的个数
+  size_t popAll(std::vector<T>* out) {
+    Node* node = head_.exchange(nullptr, std::memory_order_acq_rel);
+    Node* reversed = nullptr;
+    while (node != nullptr) {
+      Node* next = node->next;
+      node->next = reversed;
+      reversed = node;
+      node = next;
+    }
+    size_t n = 0;
+    Node* oldest = nullptr;
+    Node* newest = nullptr;
+    while (reversed != nullptr) {
+      Node* next = reversed->next;
+      T* value = reversed->value();
+      out->push_back(std::move(*value));
+      value->~T();
+      if (n < kMaxRecycled) {
+        if (oldest == nullptr) {
+          oldest = reversed;
+        }
+        reversed->next = newest;
+        newest = reversed;
+      }
+      else {
+        delete reversed;
+      }
+      reversed = next;
+      ++n;
+    }
+    if (newest != nullptr) {
+      link(&free_, oldest, newest);
+    }
+    return n;
+  }
+
+  bool empty() const { return head_.load(std::memory_order_acquire) == nullptr; }
+
+ private:
+  static const size_t kMaxRecycled = 1024;  // 一次 popAll 最多放回 free_ 的节点数，其余释放，突发之后不长期占用内存
+
+  // value 在入队时构造、出队时析构，空闲节点中没有对象
+  struct Node {
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    Node* next;
+
+    T* value() { return reinterpret_cast<T*>(&storage); }
+  };
+
+  // 本线程从 free_ 取来还没有用完的节点
+  struct NodeCache {
+    Node* head = nullptr;
+    ~NodeCache() { deleteChain(head); }
+  };
+
+  static void deleteChain(Node* node) {
+    while (node != nullptr) {
+      Node* next = node->next;
+      delete node;
+      node = next;
+    }
+  }
+
+  Node* allocate(T&& value) {
+    static thread_local NodeCache cache;
+    if (cache.head == nullptr) {
+      cache.head = free_.exchange(nullptr, std::memory_order_acquire);
+    }
+    Node* node = cache.head;
+    if (node != nullptr) {
+      cache.head = node->next;
+    }
+    else {
+      node = new Node;
+    }
+    new (node->value()) T(std::move(value));
+    node->next = nullptr;
+    return node;
+  }
+
+  // newest 到 oldest 为本地串好的一条链（newest 在前）
+  static void link(std::atomic<Node*>* list, Node* oldest, Node* newest) {
+    Node* head = list->load(std::memory_order_relaxed);
+    do {
+      oldest->next = head;
+    } while (!list->compare_exchange_weak(head, newest, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  std::atomic<Node*> head_;
+  std::atomic<Node*> free_;  // 消费者放回的空闲节点
+};
+
+#endif  // REACTOR_BASE_MPSCQUEUE_H
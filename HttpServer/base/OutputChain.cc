@@ -0,0 +1,297 @@
+#include "OutputChain.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+
+namespace {
+
+const size_t kMaxWriteBytes = 1u << 30;  // 单次 writev/sendfile 的上限，内核一次最多也只写 2GB 左右
+
+}  // namespace
+
+OutputChain::OutputChain(BufferPool* pool)
+  : head_(0),
+    bytes_(pool),
+    memoryBytes_(0),
+    fileBytes_(0),
+    zeroCopyThreshold_(0),
+    zeroCopyNext_(0),
+    zeroCopySends_(0),
+    zeroCopyCopied_(0)
+{
+}
+
+OutputChain::~OutputChain() = default;
+
+void OutputChain::append(const char* data, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  bytes_.append(data, len);
+  memoryBytes_ += len;
+  if (!empty() && segments_.back().kind == kBytes) {
+    segments_.back().length += len;
+  }
+  else {
+    segments_.push_back(Segment{kBytes, nullptr, -1, 0, len, nullptr});
+  }
+}
+
+void OutputChain::append(Buffer* data) {
+  size_t len = data->readableBytes();
+  if (len == 0) {
+    return;
+  }
+  if (zeroCopy(len)) {  // 内核在完成通知之前一直引用这段内存，存储不能再交给 bytes_ 复用
+    std::shared_ptr<Buffer> holder = std::make_shared<Buffer>(static_cast<size_t>(0));
+    holder->swap(*data);
+    data->retrieveAll();
+    appendShared(holder->beginRead(), len, holder);
+    return;
+  }
+  if (bytes_.readableBytes() != 0) {
+    append(data->beginRead(), len);
+    data->retrieveAll();
+    return;
+  }
+  bytes_.swap(*data);  // 换给 data 的是已经取空的存储
+  data->retrieveAll();
+  memoryBytes_ += len;
+  segments_.push_back(Segment{kBytes, nullptr, -1, 0, len, nullptr});
+}
+
+void OutputChain::appendShared(const char* data, size_t len, const std::shared_ptr<const void>& holder) {
+  if (len < kMinSharedSize) {
+    append(data, len);
+    return;
+  }
+  memoryBytes_ += len;
+  segments_.push_back(Segment{kShared, data, -1, 0, len, holder});
+}
+
+void OutputChain::appendFile(int fd, off_t offset, size_t length, const std::shared_ptr<const void>& holder) {
+  if (length == 0) {
+    return;
+  }
+  fileBytes_ += length;
+  segments_.push_back(Segment{kFile, nullptr, fd, offset, length, holder});
+}
+
+ssize_t OutputChain::writeFd(int fd, int* savedErrno, bool filesOnly) {
+  ssize_t total = 0;
+  while (!empty()) {
+    Segment& front = segments_[head_];
+    size_t want = 0;
+    ssize_t n;
+    if (front.kind == kFile) {
+      want = std::min(front.length, kMaxWriteBytes);
+      n = ::sendfile(fd, front.fd, &front.offset, want);  // 内核推进 offset
+      if (n == 0) {  // 文件在排队后被截断，承诺的长度无法兑现
+        *savedErrno = ENODATA;
+        return -1;
+      }
+      if (n > 0) {
+        front.length -= n;
+        fileBytes_ -= n;
+        if (front.length == 0) {
+          popFront();
+        }
+      }
+    }
+    else if (front.kind == kShared && zeroCopy(front.length)) {
+      if (filesOnly) {
+        break;
+      }
+      want = std::min(front.length, kMaxWriteBytes);
+      n = sendZeroCopy(fd, &front, want);
+      if (n > 0) {
+        consumeMemory(n);
+      }
+    }
+    else {
+      if (filesOnly) {
+        break;
+      }
+      struct iovec iov[kMaxIovecs];
+      int count = gather(iov, &want);
+      n = ::writev(fd, iov, count);
+      if (n > 0) {
+        consumeMemory(n);
+      }
+    }
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      *savedErrno = errno;
+      return errno == EAGAIN || errno == EWOULDBLOCK ? total : -1;
+    }
+    total += n;
+    if (static_cast<size_t>(n) < want) {  // 非阻塞 socket 只写出一部分说明发送缓冲区已满，不必再试一次
+      *savedErrno = EAGAIN;
+      return total;
+    }
+  }
+  return total;
+}
+
+size_t OutputChain::moveMemoryTo(Buffer* out) {
+  size_t moved = 0;
+  while (!empty() && segments_[head_].kind != kFile) {
+    Segment& front = segments_[head_];
+    if (front.kind == kShared) {
+      out->append(front.data, front.length);
+    }
+    else if (out->readableBytes() == 0 && front.length == bytes_.readableBytes()) {
+      out->swap(bytes_);
+    }
+    else {
+      out->append(bytes_.beginRead(), front.length);
+      bytes_.retrieve(front.length);
+    }
+    moved += front.length;
+    memoryBytes_ -= front.length;
+    popFront();
+  }
+  return moved;
+}
+
+// 每次成功的 MSG_ZEROCOPY 发送（包括只写出一部分）消耗一个序号，holder 保留到该序号完成
+// 超出 optmem 限制（ENOBUFS）时这一次退回普通发送
+ssize_t OutputChain::sendZeroCopy(int fd, Segment* front, size_t len) {
+  ssize_t n = ::send(fd, front->data, len, MSG_ZEROCOPY);
+  if (n < 0 && errno == ENOBUFS) {
+    return ::send(fd, front->data, len, 0);
+  }
+  if (n > 0) {
+    zeroCopyPending_.push_back(ZeroCopyPending{zeroCopyNext_++, false, front->holder});
+    ++zeroCopySends_;
+  }
+  return n;
+}
+
+bool OutputChain::reapZeroCopy(int fd) {
+  bool received = false;
+  while (true) {
+    char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        LOG_SYSERR << "OutputChain::reapZeroCopy()";
+      }
+      if (errno != EINTR) {
+        break;
+      }
+      continue;
+    }
+    received = true;
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+      const struct sock_extended_err* err = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+      if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY || err->ee_errno != 0) {
+        continue;
+      }
+      // [ee_info, ee_data] 范围内的发送都已完成，序号回绕时按差值比较
+      uint32_t lo = err->ee_info, hi = err->ee_data;
+      if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+        zeroCopyCopied_ += hi - lo + 1;
+      }
+      for (ZeroCopyPending& pending : zeroCopyPending_) {
+        if (pending.seq - lo <= hi - lo) {
+          pending.done = true;
+          pending.holder.reset();
+        }
+      }
+    }
+  }
+  while (!zeroCopyPending_.empty() && zeroCopyPending_.front().done) {
+    zeroCopyPending_.pop_front();
+  }
+  return received;
+}
+
+// 连接出错或关闭后数据已经无关紧要：正常关闭时对端已读完所有数据，内核不会再发送这些内存
+void OutputChain::clear() {
+  zeroCopyPending_.clear();
+  segments_.clear();
+  head_ = 0;
+  bytes_.retrieveAll();
+  bytes_.release();
+  memoryBytes_ = 0;
+  fileBytes_ = 0;
+}
+
+// 从头开始收集连续的内存段，自有段的数据在 bytes_ 中依次相接
+// 遇到文件区间或要用 MSG_ZEROCOPY 发送的共享段时停止
+int OutputChain::gather(struct iovec* iov, size_t* bytes) const {
+  int count = 0;
+  const char* owned = bytes_.beginRead();
+  *bytes = 0;
+  for (size_t i = head_; i < segments_.size() && count < kMaxIovecs && *bytes < kMaxWriteBytes; ++i) {
+    const Segment& seg = segments_[i];
+    if (seg.kind == kFile) {
+      break;
+    }
+    if (seg.kind == kShared && zeroCopy(seg.length)) {
+      break;
+    }
+    size_t len = std::min(seg.length, kMaxWriteBytes - *bytes);
+    if (seg.kind == kBytes) {
+      iov[count].iov_base = const_cast<char*>(owned);
+      owned += seg.length;
+    }
+    else {
+      iov[count].iov_base = const_cast<char*>(seg.data);
+    }
+    iov[count].iov_len = len;
+    *bytes += len;
+    ++count;
+  }
+  return count;
+}
+
+void OutputChain::consumeMemory(size_t n) {
+  while (n > 0) {
+    Segment& front = segments_[head_];
+    size_t len = std::min(n, front.length);
+    if (front.kind == kBytes) {
+      bytes_.retrieve(len);
+    }
+    else {
+      front.data += len;
+    }
+    front.length -= len;
+    memoryBytes_ -= len;
+    n -= len;
+    if (front.length == 0) {
+      popFront();
+    }
+  }
+}
+
+// 段全部发完时 clear，不太大的容量留给后续的响应；长期不空时把已发完的段挪走，避免无限增长
+void OutputChain::popFront() {
+  segments_[head_].holder.reset();
+  ++head_;
+  if (head_ == segments_.size()) {
+    segments_.clear();
+    head_ = 0;
+    if (segments_.capacity() > kMaxIovecs) {
+      std::vector<Segment>().swap(segments_);
+    }
+  }
+  else if (head_ >= kMaxIovecs && head_ * 2 >= segments_.size()) {
+    segments_.erase(segments_.begin(), segments_.begin() + head_);
+    head_ = 0;
+  }
+}
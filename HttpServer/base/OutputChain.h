@@ -0,0 +1,102 @@
+#ifndef REACTOR_BASE_OUTPUTCHAIN_H
+#define REACTOR_BASE_OUTPUTCHAIN_H
+
+#include "noncopyable.h"
+#include "Buffer.h"
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/*
+  TcpConnection 的待发送数据，按顺序由若干段组成：
+    自有数据：拷贝进来的字节，连续的自有段合并，全部存放在同一个 Buffer 中
+    共享数据：只读内存（如缓存的响应、压缩结果），由 holder 保活，不拷贝，多个连接可同时发送同一份
+    文件区间：用 sendfile 从 page cache 直接写入 socket，holder 保证 fd 有效
+  相邻的内存段合并为一次 writev，部分写出时在段内前进，下次从中断处继续
+  打开 MSG_ZEROCOPY 后，不小于阈值的共享数据用 send(MSG_ZEROCOPY) 发送，内核直接引用这段内存：
+  发出后 holder 继续保留，直到 reapZeroCopy() 从 socket 错误队列读到对应的完成通知
+*/
+
+class OutputChain : noncopyable {
+ public:
+  static const size_t kMinSharedSize = 512;  // 更短的共享数据直接拷贝，不值得单独占一个 iovec
+  static const int kMaxIovecs = 64;
+
+  explicit OutputChain(BufferPool* pool = nullptr);  // 自有数据的存储从 pool 借用，由持有者 release() 归还
+  ~OutputChain();
+
+  void append(const char* data, size_t len);
+  // 取走 data 中的全部数据，没有未发完的自有数据时直接交换存储
+  // 达到 MSG_ZEROCOPY 阈值时存储移入一个共享的 Buffer，按共享数据发送
+  void append(Buffer* data);
+  void appendShared(const char* data, size_t len, const std::shared_ptr<const void>& holder);
+  void appendFile(int fd, off_t offset, size_t length, const std::shared_ptr<const void>& holder);
+
+  bool empty() const { return head_ == segments_.size(); }
+  size_t memoryBytes() const { return memoryBytes_; }  // 自有和共享数据，不含文件
+  size_t fileBytes() const { return fileBytes_; }
+  size_t numSegments() const { return segments_.size() - head_; }
+  bool frontIsFile() const { return !empty() && segments_[head_].kind == kFile; }
+  size_t internalCapacity() const { return bytes_.internalCapacity() + segments_.capacity() * sizeof(Segment); }
+
+  // threshold 为 0 时不使用 MSG_ZEROCOPY；fd 需先打开 SO_ZEROCOPY，否则内核忽略该标志，也不会有完成通知
+  void setZeroCopyThreshold(size_t threshold) { zeroCopyThreshold_ = threshold; }
+  size_t zeroCopyThreshold() const { return zeroCopyThreshold_; }
+  bool zeroCopy(size_t len) const { return zeroCopyThreshold_ != 0 && len >= zeroCopyThreshold_; }
+  // 读完 fd 错误队列中的完成通知，释放内核不再引用的 holder；队列为空时返回 false
+  bool reapZeroCopy(int fd);
+  size_t zeroCopyInFlight() const { return zeroCopyPending_.size(); }  // 已发出、还没有完成通知的 send 次数
+  int64_t zeroCopySends() const { return zeroCopySends_; }
+  int64_t zeroCopyCopied() const { return zeroCopyCopied_; }  // 内核退回拷贝完成的次数（如 loopback、网卡不支持）
+
+  // 从头开始写入 fd，直到全部写完或 socket 写满（此时 *savedErrno 为 EAGAIN），返回写出的字节数
+  // 出错返回 -1，*savedErrno 为 errno，文件被截断时为 ENODATA；filesOnly 为 true 时遇到内存段即停止
+  ssize_t writeFd(int fd, int* savedErrno, bool filesOnly = false);
+  // 把开头连续的内存段移到 out 的末尾（io_uring 发送用），返回字节数；out 为空时自有数据直接交换，不拷贝
+  size_t moveMemoryTo(Buffer* out);
+  void clear();  // 同时放弃等待中的 MSG_ZEROCOPY 完成通知，只在连接出错或关闭时使用
+  // 自有数据已经发完时把存储还给 pool，语义同 Buffer::release()
+  bool release(size_t retainAbove = SIZE_MAX) { return bytes_.release(retainAbove); }
+
+ private:
+  enum Kind { kBytes, kShared, kFile };
+
+  struct Segment {
+    Kind kind;
+    const char* data;  // kShared
+    int fd;            // kFile
+    off_t offset;      // kFile
+    size_t length;     // 剩余字节数
+    std::shared_ptr<const void> holder;
+  };
+
+  struct ZeroCopyPending {
+    uint32_t seq;  // 内核按 socket 为每次 MSG_ZEROCOPY 发送分配的序号，从 0 开始
+    bool done;
+    std::shared_ptr<const void> holder;
+  };
+
+  int gather(struct iovec* iov, size_t* bytes) const;
+  ssize_t sendZeroCopy(int fd, Segment* front, size_t len);
+  void consumeMemory(size_t n);
+  void popFront();
+
+  std::vector<Segment> segments_;  // [head_, size) 为待发送的段，发完后整体 clear
+  size_t head_;
+  Buffer bytes_;  // 所有自有段的数据，按段的顺序存放
+  size_t memoryBytes_;
+  size_t fileBytes_;
+
+  size_t zeroCopyThreshold_;
+  uint32_t zeroCopyNext_;
+  std::deque<ZeroCopyPending> zeroCopyPending_;  // 按序号排列，完成通知可能合并多个序号
+  int64_t zeroCopySends_;
+  int64_t zeroCopyCopied_;
+};
+
+
+#endif  // REACTOR_BASE_OUTPUTCHAIN_H
@@ -10,6 +10,7 @@
 class Timestamp;
 class Channel;
 class EventLoop;
+class Proactor;
 
 class Poller : noncopyable {
  public:
@@ -25,6 +26,10 @@ class Poller : noncopyable {
   virtual void updateChannel(Channel* channel) = 0;
   virtual void removeChannel(Channel* channel) = 0;
   bool hasChannel(Channel * channel);
+  // 支持完成式 IO 时返回非空，见 Proactor.h
+  virtual Proactor* proactor() { return nullptr; }
+  // 能否按边沿触发注册 channel，见 Channel::setEdgeTriggered()
+  virtual bool supportsEdgeTriggered() const { return false; }
 
   void assertInLoopThread() const;
 
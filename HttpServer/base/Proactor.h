@@ -0,0 +1,41 @@
+#ifndef REACTOR_BASE_PROACTOR_H
+#define REACTOR_BASE_PROACTOR_H
+
+#include <stddef.h>
+#include <vector>
+
+class Buffer;
+class Channel;
+
+/*
+  完成式 IO 接口，USE_IO_URING=proactor 时由 IoUringPoller 提供，见 EventLoop::proactor()
+  操作先排进 ring，与下一次等待一起由一次 io_uring_enter 提交；完成后作为 channel 的 revents 经 EventLoop 正常分发：
+  收到数据、对端关闭或新连接为 POLLIN，send 完成为 POLLOUT，回调中再用 take*() 取结果
+  channel 由 startRecv/startAccept 注册，Channel::remove() 注销时撤销未完成的操作，之后到达的完成事件直接丢弃
+*/
+
+class Proactor {
+ public:
+  virtual ~Proactor() = default;
+
+  // multishot recv，数据由内核写入 poller 的 provided buffer ring，取回后追加到 input
+  virtual void startRecv(Channel* channel, Buffer* input) = 0;
+  virtual void stopRecv(Channel* channel) = 0;
+  virtual bool receiving(Channel* channel) const = 0;
+  // 返回上次以来追加到 input 的字节数，对端关闭时 *eof 为 true，出错时 *err 为 errno，之后不再接收
+  virtual size_t takeReceived(Channel* channel, bool* eof, int* err) = 0;
+
+  // 交换走 data 中的数据并发送，data 随后可继续追加；全部发完或出错时收到 POLLOUT
+  virtual void send(Channel* channel, Buffer* data) = 0;
+  virtual bool sending(Channel* channel) const = 0;
+  virtual size_t sendingBytes(Channel* channel) const = 0;
+  // 没有完成的 send 时返回 false
+  virtual bool takeSendResult(Channel* channel, int* err) = 0;
+
+  // multishot accept，新连接为非阻塞、close-on-exec
+  virtual void startAccept(Channel* channel) = 0;
+  virtual void takeAccepted(Channel* channel, std::vector<int>* fds, int* err) = 0;
+};
+
+
+#endif  // REACTOR_BASE_PROACTOR_H
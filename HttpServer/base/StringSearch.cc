@@ -0,0 +1,184 @@
+#include "StringSearch.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REACTOR_X86 1
+#endif
+
+
+namespace
+{
+
+const char* findCrlfScalar(const char* begin, const char* end) {
+  const char* p = begin;
+  while (end - p >= 2) {
+    const char* cr = static_cast<const char*>(memchr(p, '\r', end - p - 1));
+    if (cr == nullptr) {
+      return nullptr;
+    }
+    if (cr[1] == '\n') {
+      return cr;
+    }
+    p = cr + 1;
+  }
+  return nullptr;
+}
+
+const char* findCharScalar(const char* begin, const char* end, char c) {
+  return static_cast<const char*>(memchr(begin, c, end - begin));
+}
+
+const char* findLineBreakScalar(const char* begin, const char* end) {
+  for (const char* p = begin; p < end; ++p) {
+    if (*p == '\r' || *p == '\n') {
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+#ifdef REACTOR_X86
+
+// 同时比较 p 处的 '\r' 与 p+1 处的 '\n'，两个掩码相与即为 CRLF 的起始位置
+__attribute__((target("sse2")))
+const char* findCrlfSse2(const char* begin, const char* end) {
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const char* p = begin;
+  for (; end - p >= 17; p += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, cr)))
+                  & static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(b, lf)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return findCrlfScalar(p, end);
+}
+
+__attribute__((target("sse2")))
+const char* findCharSse2(const char* begin, const char* end, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  const char* p = begin;
+  for (; end - p >= 16; p += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, needle)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return findCharScalar(p, end, c);
+}
+
+__attribute__((target("sse2")))
+const char* findLineBreakSse2(const char* begin, const char* end) {
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const char* p = begin;
+  for (; end - p >= 16; p += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(a, lf))));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return findLineBreakScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* findCrlfAvx2(const char* begin, const char* end) {
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const char* p = begin;
+  for (; end - p >= 33; p += 32) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, cr)))
+                  & static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, lf)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return findCrlfSse2(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* findCharAvx2(const char* begin, const char* end, char c) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  const char* p = begin;
+  for (; end - p >= 32; p += 32) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, needle)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return findCharSse2(p, end, c);
+}
+
+__attribute__((target("avx2")))
+const char* findLineBreakAvx2(const char* begin, const char* end) {
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const char* p = begin;
+  for (; end - p >= 32; p += 32) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(a, lf))));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+  return findLineBreakSse2(p, end);
+}
+
+#endif  // REACTOR_X86
+
+
+typedef const char* (*FindCrlfFunc)(const char*, const char*);
+typedef const char* (*FindCharFunc)(const char*, const char*, char);
+
+struct SearchImpl {
+  FindCrlfFunc findCrlf;
+  FindCharFunc findChar;
+  FindCrlfFunc findLineBreak;
+  const char* name;
+};
+
+SearchImpl selectImpl() {
+#ifdef REACTOR_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SearchImpl{ findCrlfAvx2, findCharAvx2, findLineBreakAvx2, "avx2" };
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return SearchImpl{ findCrlfSse2, findCharSse2, findLineBreakSse2, "sse2" };
+  }
+#endif
+  return SearchImpl{ findCrlfScalar, findCharScalar, findLineBreakScalar, "scalar" };
+}
+
+const SearchImpl g_impl = selectImpl();  // 进程启动时选定一次
+
+} // namespace
+
+
+const char* StringSearch::findCrlf(const char* begin, const char* end) {
+  return g_impl.findCrlf(begin, end);
+}
+
+const char* StringSearch::findChar(const char* begin, const char* end, char c) {
+  return g_impl.findChar(begin, end, c);
+}
+
+const char* StringSearch::findLineBreak(const char* begin, const char* end) {
+  return g_impl.findLineBreak(begin, end);
+}
+
+const char* StringSearch::implName() {
+  return g_impl.name;
+}
@@ -0,0 +1,18 @@
+#ifndef REACTOR_BASE_STRINGSEARCH_H
+#define REACTOR_BASE_STRINGSEARCH_H
+
+// 分隔符扫描内核，x86 下按 CPU 在 AVX2 / SSE2 中选择实现，其他平台退化为逐字节扫描
+// 供 Buffer 和 HTTP 解析使用，查找范围均为 [begin, end)，找不到时返回 nullptr
+
+namespace StringSearch
+{
+  const char* findCrlf(const char* begin, const char* end);
+  const char* findChar(const char* begin, const char* end, char c);
+  const char* findLineBreak(const char* begin, const char* end);  // 第一个 '\r' 或 '\n'
+
+  const char* implName();  // "avx2" / "sse2" / "scalar"
+
+} // namespace StringSearch
+
+
+#endif  // REACTOR_BASE_STRINGSEARCH_H
@@ -1,5 +1,7 @@
 #include "TcpConnection.h"
 #include "EventLoop.h"
+#include "Proactor.h"
+#include "BufferPool.h"
 #include "Logging.h"
 #include "Timestamp.h"
 
@@ -12,17 +14,24 @@ TcpConnection::TcpConnection(EventLoop* loop,
                              const InetAddress& localAddr,
                              const InetAddress& peerAddr) 
   : loop_(loop),
+    proactor_(loop->proactor()),
     name_(name),
     state_(kConnecting),
     socket_(new Socket(sockfd)),
     channel_(new Channel(loop, sockfd)),
     localAddr_(localAddr),
-    peerAddr_(peerAddr) 
+    peerAddr_(peerAddr),
+    highWaterMark_(64*1024*1024),
+    inputBuffer_(loop->bufferPool()),
+    output_(loop->bufferPool()),
+    sendBuffer_(loop->bufferPool()),
+    shrinkScheduled_(false)
 {
   channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, _1));
   channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
   channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
   channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+  channel_->setErrorQueueCallback(std::bind(&TcpConnection::handleErrorQueue, this));
 
   LOG_DEBUG << "TcpConnection::ctor[" <<  name_ << "] at " << this
             << " fd = " << sockfd;
@@ -41,7 +50,7 @@ void TcpConnection::connectEstablished() {
   assert(state_ == kConnecting);
   setState(kConnected);
   channel_->tie(shared_from_this());
-  channel_->enableReading();
+  setReading(true);
 
   connectionCallback_(shared_from_this());
 }
@@ -54,56 +63,322 @@ void TcpConnection::connectDestroyed() {
     connectionCallback_(shared_from_this());
   }
   channel_->remove();
+  // 在 loop 线程中把缓冲区存储还给 pool，TcpConnection 本身可能在其他线程析构
+  inputBuffer_.retrieveAll();
+  inputBuffer_.release();
+  output_.clear();
+  sendBuffer_.retrieveAll();
+  sendBuffer_.release();
 }
 
+void TcpConnection::releaseBuffers() {
+  bool retained = inputBuffer_.release(kRetainBufferSize);
+  retained |= output_.release(kRetainBufferSize);
+  retained |= sendBuffer_.release(kRetainBufferSize);
+  if (retained && !shrinkScheduled_) {
+    shrinkScheduled_ = true;
+    std::weak_ptr<TcpConnection> weakThis(shared_from_this());
+    loop_->runAfter([weakThis] {
+      TcpConnectionPtr conn = weakThis.lock();
+      if (conn) {
+        conn->shrinkIdleBuffers();
+      }
+    }, kIdleShrinkSeconds);
+  }
+}
+
+// 期间若又有数据在缓冲区中，下次取空时重新计时
+void TcpConnection::shrinkIdleBuffers() {
+  shrinkScheduled_ = false;
+  inputBuffer_.release();
+  output_.release();
+  sendBuffer_.release();
+}
+
+size_t TcpConnection::memoryUsage() const {
+  return sizeof(*this) + sizeof(Channel) + sizeof(Socket) + inputBuffer_.internalCapacity()
+         + output_.internalCapacity() + sendBuffer_.internalCapacity();
+}
+
+// 在 loop 线程中调用时直接从调用者的内存写出，只有没写完的部分才拷进 output_
+// 其他线程调用时拷贝一次，连同数据一起交给 loop
 void TcpConnection::send(const void* message, size_t len) {
-  send(std::string(static_cast<const char*>(message), len));
+  if (state_ != kConnected) {
+    return;
+  }
+  if (loop_->isInLoopThread()) {
+    sendInLoop(static_cast<const char*>(message), len, nullptr);
+  }
+  else {
+    send(std::string(static_cast<const char*>(message), len));
+  }
 }
 
 void TcpConnection::send(const std::string& message) {
-  if (state_ == kConnected) {
-    loop_->runInLoop(std::bind(&TcpConnection::sendInLoop, this, message));
+  send(message.data(), message.size());
+}
+
+void TcpConnection::send(std::string&& message) {
+  if (state_ != kConnected) {
+    return;
+  }
+  if (loop_->isInLoopThread()) {
+    sendInLoop(message.data(), message.size(), nullptr);
+  }
+  else {
+    loop_->runInLoop([this, message = std::move(message)] { sendInLoop(message); });
   }
 }
 
 void TcpConnection::send(Buffer* message) {
-  if (state_ == kConnected) {
-    loop_->runInLoop(std::bind(&TcpConnection::sendInLoop, this, message->retrieveAllAsString()));
+  if (state_ != kConnected) {
+    return;
   }
+  if (loop_->isInLoopThread()) {
+    sendInLoop(message);
+  }
+  else {  // 只交换存储，不拷贝数据
+    Buffer data;
+    data.swap(*message);
+    loop_->runInLoop([this, data = std::move(data)]() mutable { sendInLoop(&data); });
+  }
+}
+
+void TcpConnection::send(Buffer&& message) {
+  send(&message);
+}
+
+void TcpConnection::sendShared(const void* data, size_t len, const std::shared_ptr<const void>& holder, Buffer* prefix) {
+  if (state_ != kConnected) {
+    return;
+  }
+  const char* p = static_cast<const char*>(data);
+  if (loop_->isInLoopThread()) {
+    if (prefix != nullptr) {  // 只排队不写，下面的 sendInLoop 一次 writev 写出两者
+      output_.append(prefix->beginRead(), prefix->readableBytes());
+      prefix->retrieveAll();
+    }
+    sendInLoop(p, len, holder);
+  }
+  else {
+    std::string head = prefix != nullptr ? prefix->retrieveAllAsString() : std::string();
+    loop_->runInLoop([this, p, len, holder, head] {
+      if (state_ != kDisconnected) {
+        output_.append(head.data(), head.size());
+      }
+      sendInLoop(p, len, holder);
+    });
+  }
+}
+
+void TcpConnection::send(const std::shared_ptr<const std::string>& blob, Buffer* prefix) {
+  sendShared(blob->data(), blob->size(), blob, prefix);
 }
 
 void TcpConnection::sendInLoop(const std::string& message) {
+  sendInLoop(message.data(), message.size(), nullptr);
+}
+
+void TcpConnection::sendInLoop(const char* data, size_t len, const std::shared_ptr<const void>& holder) {
   loop_->assertInLoopThread();
   if (state_ == kDisconnected) {
     LOG_WARN << "fd " << channel_->fd() << " disconnected, give up writing";
     return;
   }
 
-  ssize_t n = 0;
-  ssize_t remain = message.size();
-  if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0) {  // 没有待处理的写事件时直接write
-    n = ::write(channel_->fd(), message.c_str(), message.size());
-    if (n >= 0) {
-      remain -= n;
-      if (remain == 0 && writeCompleteCallback_) {
-        loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));  // queueInLoop会在下一次处理pendingFuncs时执行，runInLoop可能会直接执行
-      }
+  bool wrote = false;
+  size_t n = holder && output_.zeroCopy(len) ? 0 : writeDirectly(data, len, &wrote);
+  size_t remain = len - n;
+  if (remain > 0) {
+    checkHighWaterMark(remain);
+    if (holder) {
+      output_.appendShared(data + n, remain, holder);
     }
     else {
-      if (errno != EWOULDBLOCK) {
-        LOG_SYSERR << "TcpConnection::sendInLoop()";
-      }
+      output_.append(data + n, remain);
     }
   }
+  startWriting(wrote);
+}
 
-  if (remain > 0) {
-    outputBuffer_.append(message.data()+n, remain);
-    if (!channel_->isWriting()) {
-      channel_->enableWriting();
+// 与上面相同，只是没写完的部分连同 message 的存储一起交给 output_，不再拷贝
+void TcpConnection::sendInLoop(Buffer* message) {
+  loop_->assertInLoopThread();
+  if (state_ == kDisconnected) {
+    LOG_WARN << "fd " << channel_->fd() << " disconnected, give up writing";
+    message->retrieveAll();
+    return;
+  }
+
+  bool wrote = false;
+  if (!output_.zeroCopy(message->readableBytes())) {
+    message->retrieve(writeDirectly(message->beginRead(), message->readableBytes(), &wrote));
+  }
+  if (message->readableBytes() > 0) {
+    checkHighWaterMark(message->readableBytes());
+    output_.append(message);
+  }
+  startWriting(wrote);
+}
+
+// 没有排队的输出和待处理的写事件时直接 write，返回写出的字节数
+// proactor 模式下不直接 write，交给 io_uring 的数据与本轮其他连接的操作、下一次等待一起由一次 io_uring_enter 提交
+size_t TcpConnection::writeDirectly(const char* data, size_t len, bool* wrote) {
+  if (proactor_ != nullptr || !output_.empty() || channel_->isWriting() || len == 0) {
+    return 0;
+  }
+  *wrote = true;
+  ssize_t nwrote = ::write(channel_->fd(), data, len);
+  if (nwrote < 0) {
+    if (errno != EWOULDBLOCK) {
+      LOG_SYSERR << "TcpConnection::sendInLoop()";
+    }
+    return 0;
+  }
+  if (static_cast<size_t>(nwrote) == len && writeCompleteCallback_) {
+    queueWriteComplete();  // queueInLoop会在下一次处理pendingFuncs时执行，runInLoop可能会直接执行
+  }
+  return nwrote;
+}
+
+void TcpConnection::checkHighWaterMark(size_t remain) {
+  size_t oldLen = bufferedBytes();
+  if (highWaterMarkCallback_ && oldLen < highWaterMark_ && oldLen + remain >= highWaterMark_) {
+    TcpConnectionPtr guardThis(shared_from_this());
+    size_t bytes = oldLen + remain;
+    loop_->queueInLoop([guardThis, bytes] { guardThis->highWaterMarkCallback_(guardThis, bytes); });
+  }
+}
+
+void TcpConnection::startWriting(bool wrote) {
+  if (!output_.empty() && !writing()) {
+    if (wrote) {
+      channel_->enableWriting();  // 刚才的 write 已经写满了 socket
+    }
+    else {  // 交给 io_uring，或与 sendShared 只排队未写出的 prefix 一起 writev
+      writeOutput();
     }
   }
 }
 
+size_t TcpConnection::bufferedBytes() const {
+  size_t n = output_.memoryBytes();
+  if (proactor_ != nullptr) {
+    n += proactor_->sendingBytes(channel_.get());
+  }
+  return n;
+}
+
+void TcpConnection::sendFile(int fd, off_t offset, size_t length, const std::shared_ptr<const void>& holder) {
+  if (state_ == kConnected) {
+    loop_->runInLoop([this, fd, offset, length, holder] { sendFileInLoop(fd, offset, length, holder); });
+  }
+}
+
+void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t length, const std::shared_ptr<const void>& holder) {
+  loop_->assertInLoopThread();
+  if (state_ == kDisconnected) {
+    LOG_WARN << "fd " << channel_->fd() << " disconnected, give up sending file";
+    return;
+  }
+
+  output_.appendFile(fd, offset, length, holder);
+  if (!writing()) {  // 前面还有数据没发完时等 handleWrite
+    writeOutput();
+  }
+}
+
+// 按顺序发送 output_，直到全部发完或 socket 写满；proactor 模式下内存段交给 io_uring，文件区间仍用 sendfile
+TcpConnection::FlushResult TcpConnection::flushOutput() {
+  if (output_.zeroCopyInFlight() > 0) {  // 读写都暂停时 channel 不在 poller 中，收不到错误队列的事件
+    output_.reapZeroCopy(channel_->fd());
+  }
+  while (!output_.empty()) {
+    if (proactor_ != nullptr && !output_.frontIsFile()) {
+      output_.moveMemoryTo(&sendBuffer_);
+      proactor_->send(channel_.get(), &sendBuffer_);
+      return kSubmitted;
+    }
+    int savedErrno = 0;
+    if (output_.writeFd(channel_->fd(), &savedErrno, proactor_ != nullptr) < 0) {
+      errno = savedErrno;
+      LOG_SYSERR << "TcpConnection::flushOutput()";
+      abortOutput();
+      return kFailed;
+    }
+    if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK) {
+      return kPending;
+    }
+  }
+  return kAllSent;
+}
+
+// 发送 output_ 并根据结果开关写事件
+TcpConnection::FlushResult TcpConnection::writeOutput() {
+  FlushResult result = flushOutput();
+  if (result == kAllSent) {
+    if (channel_->isWriting()) {
+      channel_->disableWriting();
+    }
+    if (writeCompleteCallback_) {
+      queueWriteComplete();
+    }
+  }
+  else if (result == kPending && !channel_->isWriting()) {
+    channel_->enableWriting();
+  }
+  else if (result == kSubmitted && channel_->isWriting()) {
+    channel_->disableWriting();
+  }
+  if (result != kPending) {
+    releaseBuffers();
+  }
+  return result;
+}
+
+// 出错后已承诺的数据无法发完，丢弃剩余输出并关闭连接，读端随后会收到 0 走 handleClose
+void TcpConnection::abortOutput() {
+  output_.clear();
+  if (channel_->isWriting()) {
+    channel_->disableWriting();
+  }
+  if (!reading()) {  // 读被暂停时没有事件能通知关闭
+    setReading(true);
+  }
+  socket_->shutdown();
+}
+
+// 只捕获 shared_ptr，EventLoop::Functor 内联存放，不复制 writeCompleteCallback_
+void TcpConnection::queueWriteComplete() {
+  TcpConnectionPtr guardThis(shared_from_this());
+  loop_->queueInLoop([guardThis] { guardThis->writeCompleteCallback_(guardThis); });
+}
+
+bool TcpConnection::reading() const {
+  return proactor_ != nullptr ? proactor_->receiving(channel_.get()) : channel_->isReading();
+}
+
+bool TcpConnection::writing() const {
+  return channel_->isWriting() || (proactor_ != nullptr && proactor_->sending(channel_.get()));
+}
+
+void TcpConnection::setReading(bool on) {
+  if (proactor_ != nullptr) {
+    if (on) {
+      proactor_->startRecv(channel_.get(), &inputBuffer_);
+    }
+    else {
+      proactor_->stopRecv(channel_.get());
+    }
+  }
+  else if (on) {
+    channel_->enableReading();
+  }
+  else {
+    channel_->disableReading();
+  }
+}
+
 void TcpConnection::shutdown() {
   StateE connected = kConnected;
   if (state_.compare_exchange_strong(connected, kDisconnecting)) {
@@ -114,19 +389,79 @@ void TcpConnection::shutdown() {
 
 void TcpConnection::shutdownInLoop() {
   loop_->assertInLoopThread();
-  if (!channel_->isWriting()) {
+  if (!writing()) {
     // socket_->shutdownWrite();
     socket_->shutdown();
+    if (state_ != kDisconnected && !reading()) {  // 读被暂停时恢复，才能收到对端关闭
+      setReading(true);
+    }
+  }
+}
+
+void TcpConnection::startRead() {
+  loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, this));
+}
+
+void TcpConnection::startReadInLoop() {
+  loop_->assertInLoopThread();
+  if (state_ != kDisconnected && !reading()) {
+    setReading(true);
+    if (channel_->edgeTriggered()) {  // 暂停期间的边沿已被丢弃，补读一次
+      queueEdgeRead();
+    }
+  }
+}
+
+void TcpConnection::setEdgeTriggered(bool on) {
+  assert(state_ == kConnecting);
+  if (proactor_ == nullptr) {
+    channel_->setEdgeTriggered(on);
+  }
+}
+
+void TcpConnection::stopRead() {
+  loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, this));
+}
+
+void TcpConnection::stopReadInLoop() {
+  loop_->assertInLoopThread();
+  if (state_ != kDisconnected && reading()) {
+    setReading(false);
   }
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime) {
   loop_->assertInLoopThread();
 
+  if (proactor_ != nullptr) {  // 数据已由 poller 从 provided buffer 追加到 inputBuffer_
+    bool eof = false;
+    int err = 0;
+    size_t n = proactor_->takeReceived(channel_.get(), &eof, &err);
+    if (n > 0) {
+      messageCallback_(shared_from_this(), inputBuffer(), receiveTime);
+      releaseBuffers();
+    }
+    if (err != 0) {
+      errno = err;
+      LOG_SYSERR << "TcpConnection::handleRead()";
+    }
+    if ((eof || err != 0) && state_ != kDisconnected) {  // recv 已经结束，不会再有事件
+      handleClose();
+    }
+    return;
+  }
+
+  if (channel_->edgeTriggered()) {
+    handleReadEdgeTriggered(receiveTime);
+    releaseBuffers();
+    return;
+  }
+
   int savedErrno = 0;
   ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
   if (n > 0) {
     messageCallback_(shared_from_this(), inputBuffer(), receiveTime);
+    releaseBuffers();
   }
   else if (n == 0) {
     handleClose();  // TODO: 这是否会造成多次close回调？在channel中激活read回调的时候不应该激活close回调
@@ -137,28 +472,65 @@ void TcpConnection::handleRead(Timestamp receiveTime) {
   }
 }
 
-void TcpConnection::handleWrite() {
-  loop_->assertInLoopThread();
-
-  if (channel_->isWriting()) {  // 这里也可用 kConnected | kDisconnecting判断
-    ssize_t n = ::write(channel_->fd(), outputBuffer_.beginRead(), outputBuffer_.readableBytes());
+void TcpConnection::handleReadEdgeTriggered(Timestamp receiveTime) {
+  size_t budget = kEdgeReadBudget;
+  while (true) {
+    int savedErrno = 0;
+    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
     if (n > 0) {
-      outputBuffer_.retrieve(n);
-      if (outputBuffer_.readableBytes() == 0) {
-        channel_->disableWriting();
-        if (writeCompleteCallback_) {
-          loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
-        }
-        if (state_ == kDisconnecting) {
-          shutdownInLoop();
-        }
+      messageCallback_(shared_from_this(), inputBuffer(), receiveTime);
+      // 即使没有读满也要读到 EAGAIN：数据和 FIN 一起到达时只有一个边沿，之后的 read() 返回 0 不会再有事件通知
+      if (state_ == kDisconnected || !channel_->isReading()) {
+        return;
+      }
+      if (static_cast<size_t>(n) >= budget) {
+        queueEdgeRead();
+        return;
       }
+      budget -= n;
     }
-    else {
-      LOG_SYSERR << "TcpConnection::handleWrite()";
+    else if (n == 0) {
+      handleClose();
+      return;
+    }
+    else if (savedErrno != EINTR) {
+      if (savedErrno != EAGAIN) {
+        errno = savedErrno;
+        LOG_SYSERR << "TcpConnection::handleReadEdgeTriggered()";
+      }
+      return;
     }
   }
-  else {  // 写之前对方就关闭了连接，服务端调用TcpConnection::handleClose()关闭了channel
+}
+
+// 没有新的边沿，在本轮 doPendingFunctors 中（其他连接的事件都处理完之后）接着读
+void TcpConnection::queueEdgeRead() {
+  TcpConnectionPtr guardThis(shared_from_this());
+  loop_->queueInLoop([guardThis] {
+    if (guardThis->state_ != kDisconnected && guardThis->channel_->isReading()) {
+      guardThis->handleRead(Timestamp::now());
+    }
+  });
+}
+
+void TcpConnection::handleWrite() {
+  loop_->assertInLoopThread();
+
+  int err = 0;
+  bool sent = proactor_ != nullptr && proactor_->takeSendResult(channel_.get(), &err);  // io_uring 的 send 完成
+  if (sent && err != 0 && state_ != kDisconnected) {
+    errno = err;
+    LOG_SYSERR << "TcpConnection::handleWrite() send";
+    abortOutput();
+    return;
+  }
+
+  if ((channel_->isWriting() || sent) && state_ != kDisconnected) {  // 这里也可用 kConnected | kDisconnecting判断
+    if (writeOutput() == kAllSent && state_ == kDisconnecting) {
+      shutdownInLoop();
+    }
+  }
+  else if (!channel_->edgeTriggered()) {  // 写之前对方就关闭了连接，服务端调用TcpConnection::handleClose()关闭了channel
     LOG_TRACE << "Connection fd = " << channel_->fd() << " is down, no more writing";
   }
 }
@@ -169,12 +541,26 @@ void TcpConnection::handleClose() {
   assert(state_ == kConnected || state_ == kDisconnecting);
   setState(kDisconnected);
   channel_->disableAll();
+  if (proactor_ != nullptr) {
+    proactor_->stopRecv(channel_.get());
+  }
 
   TcpConnectionPtr guardThis(shared_from_this());
   connectionCallback_(guardThis);
   closeCallback_(guardThis);  // 移除 server map 中的 this, 再执行 connectDestroyed
 }
 
+void TcpConnection::setZeroCopyThreshold(size_t threshold) {
+  if (threshold != 0 && proactor_ == nullptr && socket_->setZeroCopy(true)) {
+    output_.setZeroCopyThreshold(threshold);
+  }
+}
+
+// MSG_ZEROCOPY 的完成通知，没有打开时交给 handleError
+bool TcpConnection::handleErrorQueue() {
+  return output_.zeroCopyThreshold() != 0 && output_.reapZeroCopy(channel_->fd());
+}
+
 void TcpConnection::handleError() {
   int err;
   socklen_t errlen = sizeof(err);
@@ -4,14 +4,17 @@
 #include "noncopyable.h"
 #include "Acceptor.h"
 #include "Buffer.h"
+#include "OutputChain.h"
 #include "Callbacks.h"
 
 #include <boost/any.hpp>
 #include <atomic>
+#include <sys/types.h>
 
 
 class EventLoop;
 class Channel;
+class Proactor;
 
 
 class TcpConnection : noncopyable,
@@ -38,34 +41,93 @@ class TcpConnection : noncopyable,
   void setConnectionCallback(const ConnectionCallback& cb) { connectionCallback_ = cb; }
   void setMessageCallback(const MessageCallback& cb) { messageCallback_ = cb; }
   void setWriteCompleteCallback(const WriteCompleteCallback& cb) { writeCompleteCallback_ = cb; }
+  // 待发送的内存数据（自有和共享数据，不含文件区间）增长到 highWaterMark 时回调一次
+  void setHighWaterMarkCallback(const HighWaterMarkCallback& cb, size_t highWaterMark)
+  { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; }
   void setCloseCallback(const CloseCallback& cb) { closeCallback_ = cb; }
 
   Buffer* inputBuffer() { return &inputBuffer_; }
-  Buffer* outputBuffer() { return &outputBuffer_; }
+  const OutputChain& outputChain() const { return output_; }
+  // 连接对象及其缓冲区当前占用的字节数，不含共享数据、文件和内核 socket 缓冲区
+  size_t memoryUsage() const;
 
   void setContext(const boost::any& context) { context_ = context; }
   const boost::any& getContext() const { return context_; }
 
+  // 在 loop 线程中调用时直接写出调用者的数据，没写完的部分才进入输出缓冲；其他线程调用时交给 loop 再发送
   void send(const void* message, size_t len);
   void send(const std::string& message);
+  void send(std::string&& message);  // 其他线程调用时移动而不是拷贝
+  // 取走 message 中的全部数据，没写完的部分连同存储一起交换进输出缓冲，不拷贝
   void send(Buffer* message);
+  void send(Buffer&& message);
   void sendInLoop(const std::string& message);
+  // 发送共享的只读数据（如缓存的响应），不拷贝，holder 一直持有到发送完成（或连接断开）
+  // prefix 非空时先发送其中的数据（如响应头）并将其取走，与 data 由同一次 writev 写出
+  void sendShared(const void* data, size_t len, const std::shared_ptr<const void>& holder, Buffer* prefix = nullptr);
+  void send(const std::shared_ptr<const std::string>& blob, Buffer* prefix = nullptr);
+  // 把文件区间 [offset, offset+length) 排在已有输出之后，用 sendfile 发送，数据不经过用户态
+  // holder 在发送完成（或连接断开）前一直持有，用来保证 fd 有效
+  void sendFile(int fd, off_t offset, size_t length, const std::shared_ptr<const void>& holder);
 
   void shutdown();
   void shutdownInLoop();
 
+  // 暂停/恢复读事件，上层来不及处理时不再从 socket 读入数据，由 TCP 流控让对端慢下来
+  void startRead();
+  void stopRead();
+
+  // 边沿触发：一个读事件中循环读到 socket 读空，开关写事件不再调用 epoll_ctl
+  // 每个读事件最多读 kEdgeReadBudget 字节，剩下的排到本轮其他连接之后，避免一个连接占住 loop
+  // 需在 connectEstablished() 之前设置，poller 不支持或 proactor 模式下忽略
+  void setEdgeTriggered(bool on);
+  static const size_t kEdgeReadBudget = 256 * 1024;
+
+  // 不小于 threshold 字节的共享数据（缓存的响应、send(Buffer*) 交出的大块数据）用 MSG_ZEROCOPY 发送，不拷贝进内核
+  // 数据由 holder 保活到 socket 错误队列中的完成通知到达，见 OutputChain；0 表示关闭
+  // 需在 connectEstablished() 之前设置，proactor 模式或内核不支持时忽略
+  void setZeroCopyThreshold(size_t threshold);
+
+  // 缓冲区取空后存储还给 loop 的 BufferPool，空闲连接不占缓冲区内存
+  // 超过 kRetainBufferSize 的存储先留给紧接着的大消息，kIdleShrinkSeconds 内没有再用到才归还
+  static const size_t kRetainBufferSize = 4096;
+  static const int kIdleShrinkSeconds = 2;
+
  private:
   enum StateE { kDisconnected, kConnecting, kConnected, kDisconnecting };
+  enum FlushResult { kAllSent, kPending, kSubmitted, kFailed };  // kSubmitted: 已交给 io_uring 发送，完成后回到 handleWrite
 
   void setState(StateE state) { state_ = state; }
   void handleRead(Timestamp receiveTime);
   void handleWrite();
   void handleClose();
   void handleError();
+  bool handleErrorQueue();
+  void sendInLoop(const char* data, size_t len, const std::shared_ptr<const void>& holder);  // holder 为空时拷贝
+  void sendInLoop(Buffer* message);
+  size_t writeDirectly(const char* data, size_t len, bool* wrote);
+  void checkHighWaterMark(size_t remain);
+  void startWriting(bool wrote);
+  void sendFileInLoop(int fd, off_t offset, size_t length, const std::shared_ptr<const void>& holder);
+  FlushResult flushOutput();
+  FlushResult writeOutput();
+  void abortOutput();
+  void queueWriteComplete();
+  void releaseBuffers();
+  void shrinkIdleBuffers();
+  void handleReadEdgeTriggered(Timestamp receiveTime);
+  void queueEdgeRead();
+  size_t bufferedBytes() const;
+  bool reading() const;
+  bool writing() const;
+  void setReading(bool on);
+  void startReadInLoop();
+  void stopReadInLoop();
 
   const char* stateToString() const;
 
   EventLoop* loop_;
+  Proactor* proactor_;  // 非空时读写由 io_uring 完成，不再使用 channel 的读写事件（sendfile 仍等待 POLLOUT）
   std::string name_;
   std::atomic<StateE> state_;
   std::unique_ptr<Socket> socket_;
@@ -76,10 +138,14 @@ class TcpConnection : noncopyable,
   ConnectionCallback connectionCallback_;
   MessageCallback messageCallback_;
   WriteCompleteCallback writeCompleteCallback_;
+  HighWaterMarkCallback highWaterMarkCallback_;
   CloseCallback closeCallback_;
+  size_t highWaterMark_;
 
   Buffer inputBuffer_;
-  Buffer outputBuffer_;
+  OutputChain output_;
+  Buffer sendBuffer_;  // proactor 模式下交给 io_uring 的数据，由 output_ 开头的内存段移入
+  bool shrinkScheduled_;
   boost::any context_;
 
 };
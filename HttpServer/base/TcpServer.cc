@@ -36,9 +36,12 @@ TcpServer::TcpServer(EventLoop* loop, const InetAddress& listenAddr, const std::
     name_(name),
     connectionCallback_(defaultConnectionCallback),
     messageCallback_(defaultMessageCallback),
+    edgeTriggered_(false),
+    zeroCopyThreshold_(0),
     started_(false),
     threadPool_(new EventLoopThreadPool(loop_, name_)),
-    nextConnId_(1)
+    nextConnId_(1),
+    currentNumConnections_(0)
 {
   acceptor_->setNewConnectionCallback(
     std::bind(&TcpServer::newConnection, this, _1, _2)
@@ -101,6 +104,8 @@ void TcpServer::newConnection(int sockfd, const InetAddress& peerAddr) {
   conn->setMessageCallback(messageCallback_);
   conn->setWriteCompleteCallback(writeCompleteCallback_);
   conn->setCloseCallback(std::bind(&TcpServer::removeConnection, this, _1));  // TODO: bind conn to _1 似乎conn就不能析构了
+  conn->setEdgeTriggered(edgeTriggered_);
+  conn->setZeroCopyThreshold(zeroCopyThreshold_);
   ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
 }
 
@@ -26,6 +26,10 @@ class TcpServer : noncopyable {
   void setConnectionCallback(const ConnectionCallback& cb) { connectionCallback_ = cb; }
   void setMessageCallback(const MessageCallback& cb) { messageCallback_ = cb; }
   void setWriteCompleteCallback(const WriteCompleteCallback& cb) { writeCompleteCallback_ = cb; }
+  // 新连接的 socket 按边沿触发注册，见 TcpConnection::setEdgeTriggered()，在 start() 之前设置
+  void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+  // 新连接的 MSG_ZEROCOPY 阈值，见 TcpConnection::setZeroCopyThreshold()，0 表示关闭，在 start() 之前设置
+  void setZeroCopyThreshold(size_t threshold) { zeroCopyThreshold_ = threshold; }
 
  private:
   void newConnection(int sockfd, const InetAddress& peerAddr);  // for Acceptor
@@ -39,6 +43,8 @@ class TcpServer : noncopyable {
   ConnectionCallback connectionCallback_;
   MessageCallback messageCallback_;
   WriteCompleteCallback writeCompleteCallback_;
+  bool edgeTriggered_;
+  size_t zeroCopyThreshold_;
   std::atomic<bool> started_;
   std::map<std::string, TcpConnectionPtr> connections_;
 
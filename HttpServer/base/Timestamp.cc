@@ -1,6 +1,7 @@
 #include "Timestamp.h"
 
 #include <sys/time.h>
+#include <time.h>
 
 
 std::string Timestamp::toLocalTime(bool microSecond) {
@@ -8,13 +8,39 @@
 #include "base/TcpConnection.h"
 #include "base/Timestamp.h"
 #include "base/AsyncLogging.h"
+#include "base/Thread.h"
+#include "base/CurrentThread.h"
+#include "base/CountDownLatch.h"
+#include "base/StringSearch.h"
+#include "base/BufferPool.h"
+#include "HttpParser.h"
+#include "HttpHeaders.h"
+#include "HttpConnection.h"
+#include "HttpConfig.h"
+#include "HttpConnectionPool.h"
+#include "FileCache.h"
+#include "ResponseCache.h"
+#include "Compression.h"
 
 #include <string.h>
+#include <time.h>
 #include <sys/timerfd.h>
 #include <sys/time.h>
 #include <iostream>
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <atomic>
 #include <boost/any.hpp>
+#include <regex>
+#include <map>
 
 
 using namespace std;
@@ -190,7 +216,1324 @@ void testAsyncLogging() {
     }
 }
 
-int main() {
+const char* kBenchRequest =
+    "GET /css/bootstrap.min.css HTTP/1.1\r\n"
+    "Host: 127.0.0.1:12345\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Referer: http://127.0.0.1:12345/\r\n"
+    "\r\n";
+
+bool regexParse(Buffer* buf) {  // 原先 HttpConnection 中基于 std::regex 的解析流程
+    std::string method, path, version;
+    std::map<std::string, std::string> header;
+    const char* crlf = buf->findCrlf();
+    std::string line = buf->retrieveAsString(crlf - buf->beginRead());
+    buf->retrieve(2);
+    std::regex pattern("^([^ ]+) ([^ ]+) HTTP/([^ ]+)$");
+    std::smatch result;
+    if (!std::regex_match(line, result, pattern)) {
+        return false;
+    }
+    method = result[1];
+    path = result[2];
+    version = result[3];
+    while ((crlf = buf->findCrlf()) != nullptr) {
+        line = buf->retrieveAsString(crlf - buf->beginRead());
+        buf->retrieve(2);
+        if (line.empty()) {
+            return header.find("Connection") != header.end();
+        }
+        std::regex headerPattern("^([^:]+): *(.+)$");
+        if (!std::regex_match(line, result, headerPattern)) {
+            return false;
+        }
+        header[result[1]] = result[2];
+    }
+    return false;
+}
+
+void benchRequestParser() {
+    const int kRounds = 200000;
+    size_t len = strlen(kBenchRequest);
+    Buffer buf;
+
+    Timestamp start = Timestamp::now();
+    for (int i = 0; i < kRounds / 10; ++i) {
+        buf.append(kBenchRequest, len);
+        bool ok = regexParse(&buf);
+        assert(ok); (void)ok;
+        buf.retrieveAll();
+    }
+    double regexSec = static_cast<double>(Timestamp::now().microSecondsSinceEpoch()
+                                          - start.microSecondsSinceEpoch()) / 1e6;
+
+    HttpParser parser;
+    start = Timestamp::now();
+    for (int i = 0; i < kRounds; ++i) {
+        buf.append(kBenchRequest, len);
+        bool ok = parser.parse(&buf) == HttpParser::kComplete && !parser.findHeader("Connection").empty();
+        assert(ok); (void)ok;
+        buf.retrieve(parser.headerLength());
+        parser.reset();
+    }
+    double parserSec = static_cast<double>(Timestamp::now().microSecondsSinceEpoch()
+                                           - start.microSecondsSinceEpoch()) / 1e6;
+
+    printf("std::regex:  %10.0f req/s\n", kRounds / 10 / regexSec);
+    printf("HttpParser:  %10.0f req/s\n", kRounds / parserSec);
+}
+
+void benchSearch() {
+    const int kRounds = 100000;
+    std::string block(8192, 'x');
+    block += "\r\n";
+    const char* begin = block.data();
+    const char* end = begin + block.size();
+    const char* kCRLF = "\r\n";
+
+    Timestamp start = Timestamp::now();
+    for (int i = 0; i < kRounds; ++i) {
+        const char* crlf = std::search(begin, end, kCRLF, kCRLF+2);
+        assert(crlf == end - 2); (void)crlf;
+    }
+    double searchSec = static_cast<double>(Timestamp::now().microSecondsSinceEpoch()
+                                           - start.microSecondsSinceEpoch()) / 1e6;
+
+    start = Timestamp::now();
+    for (int i = 0; i < kRounds; ++i) {
+        const char* crlf = StringSearch::findCrlf(begin, end);
+        assert(crlf == end - 2); (void)crlf;
+    }
+    double simdSec = static_cast<double>(Timestamp::now().microSecondsSinceEpoch()
+                                         - start.microSecondsSinceEpoch()) / 1e6;
+
+    double mb = static_cast<double>(block.size()) * kRounds / (1024*1024);
+    printf("std::search:          %8.0f MB/s\n", mb / searchSec);
+    printf("findCrlf (%s):     %8.0f MB/s\n", StringSearch::implName(), mb / simdSec);
+}
+
+const char kIoResponse[] = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nConnection: keep-alive\r\n\r\nhello";
+const char kIoRequest[] = "GET / HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+const size_t kIoBulkSize = 1024 * 1024;
+
+// 每个空行结束一个请求
+template <typename Respond>
+void forEachIoRequest(const TcpConnectionPtr& conn, Buffer* buf, Respond respond) {
+    const char kBlank[] = "\r\n\r\n";
+    const char* end;
+    while ((end = std::search(buf->beginRead(), buf->beginRead() + buf->readableBytes(), kBlank, kBlank + 4))
+           != buf->beginRead() + buf->readableBytes()) {
+        buf->retrieveUntil(end + 4);
+        respond(conn);
+    }
+}
+
+void ioMessageCallback(const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+    forEachIoRequest(conn, buf, [](const TcpConnectionPtr& c) { c->send(kIoResponse, sizeof(kIoResponse) - 1); });
+}
+
+void ioBulkResponseCallback(const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+    static const std::string response(kIoBulkSize, 'r');
+    forEachIoRequest(conn, buf, [](const TcpConnectionPtr& c) { c->send(response); });
+}
+
+void ioUploadCallback(const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+    while (buf->readableBytes() >= kIoBulkSize) {
+        buf->retrieve(kIoBulkSize);
+        conn->send("ok", 2);
+    }
+}
+
+// 响应头 + 共享的响应体，与 HttpConnection 发送缓存响应的方式相同；copy 为 true 时拷贝进输出缓冲区
+template <size_t kBodySize, bool kCopy>
+void ioBlobCallback(const TcpConnectionPtr& conn, Buffer* buf, Timestamp) {
+    static const std::shared_ptr<const std::string> body = std::make_shared<const std::string>(kBodySize, 'b');
+    forEachIoRequest(conn, buf, [](const TcpConnectionPtr& c) {
+        char header[96];
+        int n = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n", kBodySize);
+        if (kCopy) {
+            std::string response(header, n);
+            response += *body;
+            c->send(response);
+        }
+        else {
+            Buffer prefix;
+            prefix.append(header, n);
+            c->send(body, &prefix);
+        }
+    });
+}
+
+template <size_t kBodySize>
+size_t ioBlobResponseLength() {
+    char header[96];
+    return snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n", kBodySize) + kBodySize;
+}
+
+struct IoWorkload {
+    const char* name;
+    MessageCallback onMessage;
+    std::string request;
+    size_t responseLen;
+    size_t zeroCopyThreshold = 0;
+};
+
+// 一个连接上一问一答，直到 stop
+void ioClient(int port, const std::atomic<bool>* stop, std::atomic<int64_t>* requests, const IoWorkload* workload) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        perror("connect");
+        ::close(fd);
+        return;
+    }
+    std::vector<char> buf(64 * 1024);
+    const std::string& request = workload->request;
+    int64_t n = 0;
+    bool ok = true;
+    while (ok && !*stop) {
+        for (size_t sent = 0; ok && sent < request.size(); ) {
+            ssize_t w = ::write(fd, request.data() + sent, request.size() - sent);
+            ok = w > 0;
+            sent += ok ? static_cast<size_t>(w) : 0;
+        }
+        for (size_t got = 0; ok && got < workload->responseLen; ) {
+            ssize_t r = ::read(fd, buf.data(), std::min(buf.size(), workload->responseLen - got));
+            ok = r > 0;
+            got += ok ? static_cast<size_t>(r) : 0;
+        }
+        n += ok ? 1 : 0;
+    }
+    *requests += n;
+    ::close(fd);
+}
+
+// /proc 中按线程统计的 read/write 类系统调用次数，io_uring 提交的操作不计入
+int64_t threadRwSyscalls() {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/io", CurrentThread::tid());
+    FILE* fp = fopen(path, "r");
+    if (fp == nullptr) {
+        return 0;
+    }
+    char line[128];
+    int64_t total = 0;
+    long long v;
+    while (fgets(line, sizeof(line), fp) != nullptr) {
+        if (sscanf(line, "syscr: %lld", &v) == 1 || sscanf(line, "syscw: %lld", &v) == 1) {
+            total += v;
+        }
+    }
+    fclose(fp);
+    return total;
+}
+
+double threadCpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+           + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// 替换 libc 的 epoll_ctl，统计 poller 改动注册的次数
+std::atomic<int64_t> g_epollCtls(0);
+
+extern "C" int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) noexcept {
+    ++g_epollCtls;
+    return static_cast<int>(::syscall(SYS_epoll_ctl, epfd, op, fd, event));
+}
+
+// 服务端为单个 loop（本线程），每次循环恰好一次 epoll_wait 或 io_uring_enter，
+// 系统调用数按 循环次数 + read/write 类调用 + epoll_ctl 计算
+void runIoBench(const char* name, const IoWorkload& workload, bool edgeTriggered, int numConns, int seconds, int port) {
+    EventLoop loop;
+    // 连接断开时累计零拷贝统计，只在 loop 线程中修改；server 析构时还会回调，需在 server 之前构造
+    std::atomic<int> closed(0);
+    int64_t zeroCopySends = 0, zeroCopyCopied = 0;
+    TcpServer server(&loop, InetAddress(port), "bench_io");
+    server.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+        if (!conn->connected()) {
+            zeroCopySends += conn->outputChain().zeroCopySends();
+            zeroCopyCopied += conn->outputChain().zeroCopyCopied();
+            ++closed;
+        }
+    });
+    server.setMessageCallback(workload.onMessage);
+    server.setEdgeTriggered(edgeTriggered);
+    server.setZeroCopyThreshold(workload.zeroCopyThreshold);
+    server.start();
+
+    std::atomic<bool> stop(false);
+    std::atomic<int64_t> requests(0);
+    Thread controller([&] {
+        std::vector<std::unique_ptr<Thread>> clients;
+        for (int i = 0; i < numConns; ++i) {
+            clients.emplace_back(new Thread(std::bind(ioClient, port, &stop, &requests, &workload)));
+            clients.back()->start();
+        }
+        sleep(seconds);
+        stop = true;
+        for (auto& client : clients) {
+            client->join();
+        }
+        // 等 server 处理完客户端的关闭再退出，否则排队的 connectDestroyed 没有执行，连接随 loop 析构时 channel 仍在 poller 中
+        for (int i = 0; i < 100 && closed < numConns; ++i) {
+            usleep(10 * 1000);
+        }
+        loop.quit();
+    }, "bench_io");
+
+    int64_t iter0 = loop.iteration(), sys0 = threadRwSyscalls(), ctl0 = g_epollCtls;
+    double cpu0 = threadCpuSeconds();
+    controller.start();
+    loop.loop();
+    controller.join();
+    double reqs = static_cast<double>(requests);
+    double iters = static_cast<double>(loop.iteration() - iter0);
+    double rw = static_cast<double>(threadRwSyscalls() - sys0);
+    double ctls = static_cast<double>(g_epollCtls - ctl0);
+    double cpu = threadCpuSeconds() - cpu0;
+    printf("%-20s %9.0f req/s  %6.2f loop iterations/req  %6.2f epoll_ctl/req  %6.2f syscalls/req  %7.2f us cpu/req\n",
+           name, reqs / seconds, iters / reqs, ctls / reqs, (iters + rw + ctls) / reqs, cpu * 1e6 / reqs);
+    if (workload.zeroCopyThreshold != 0) {
+        printf("%-20s %9lld MSG_ZEROCOPY sends, %lld completed by copying\n", "", static_cast<long long>(zeroCopySends),
+               static_cast<long long>(zeroCopyCopied));
+    }
+}
+
+// epoll / io_uring poll / io_uring proactor 三种模式的 A/B 对比
+void benchIo(int numConns, int seconds) {
+    const char* modes[] = { nullptr, "1", "proactor" };
+    const char* names[] = { "epoll", "io_uring poll", "io_uring proactor" };
+    IoWorkload workload{ "small", ioMessageCallback, kIoRequest, sizeof(kIoResponse) - 1 };
+    Logger::setLogLevel(Logger::WARN);
+    printf("%d connections, %d s each, 1 request in flight per connection\n", numConns, seconds);
+    for (int m = 0; m < 3; ++m) {
+        if (modes[m] == nullptr) {
+            unsetenv("USE_IO_URING");
+        }
+        else {
+            setenv("USE_IO_URING", modes[m], 1);
+        }
+        runIoBench(names[m], workload, false, numConns, seconds, 23456 + m);
+    }
+    unsetenv("USE_IO_URING");
+}
+
+// epoll 水平触发与边沿触发的对比：小请求、1MB 响应、1MB 上传
+void benchEdgeTriggered(int numConns, int seconds) {
+    IoWorkload workloads[] = {
+        { "small", ioMessageCallback, kIoRequest, sizeof(kIoResponse) - 1 },
+        { "1MB response", ioBulkResponseCallback, kIoRequest, kIoBulkSize },
+        { "1MB upload", ioUploadCallback, std::string(kIoBulkSize, 'u'), 2 },
+    };
+    Logger::setLogLevel(Logger::WARN);
+    unsetenv("USE_IO_URING");
+    printf("%d connections, %d s each, 1 request in flight per connection\n", numConns, seconds);
+    int port = 23460;
+    for (const IoWorkload& workload : workloads) {
+        for (int et = 0; et < 2; ++et) {
+            char name[64];
+            snprintf(name, sizeof(name), "%s %s", workload.name, et ? "ET" : "LT");
+            runIoBench(name, workload, et, numConns, seconds, port++);
+        }
+    }
+}
+
+// 多个生产者线程向同一个 loop 投递回调，分别逐个 queueInLoop 和每 kBatch 个 queueBatchInLoop
+// 生产者线程的 write 类系统调用即 eventfd 写入次数
+// 输出链：响应体拷贝进输出缓冲区 与 作为共享段由 writev 和响应头一起发送 的对比
+void benchChain(int numConns, int seconds) {
+    IoWorkload workloads[] = {
+        { "16KB copy", ioBlobCallback<16 * 1024, true>, kIoRequest, ioBlobResponseLength<16 * 1024>() },
+        { "16KB shared", ioBlobCallback<16 * 1024, false>, kIoRequest, ioBlobResponseLength<16 * 1024>() },
+        { "256KB copy", ioBlobCallback<256 * 1024, true>, kIoRequest, ioBlobResponseLength<256 * 1024>() },
+        { "256KB shared", ioBlobCallback<256 * 1024, false>, kIoRequest, ioBlobResponseLength<256 * 1024>() },
+    };
+    Logger::setLogLevel(Logger::WARN);
+    unsetenv("USE_IO_URING");
+    printf("%d connections, %d s each, 1 request in flight per connection\n", numConns, seconds);
+    int port = 23470;
+    for (const IoWorkload& workload : workloads) {
+        runIoBench(workload.name, workload, false, numConns, seconds, port++);
+    }
+}
+
+// 共享的响应体用普通 writev 与 MSG_ZEROCOPY 发送的对比，64KB 到 8MB
+// loopback 上内核在交给接收方时仍要拷贝（完成通知带 COPIED），只能看出额外的通知开销，收益需在真实网卡上测
+void benchZeroCopy(int numConns, int seconds) {
+    const size_t kThreshold = 64 * 1024;
+    IoWorkload workloads[] = {
+        { "64KB write", ioBlobCallback<64 * 1024, false>, kIoRequest, ioBlobResponseLength<64 * 1024>() },
+        { "64KB zerocopy", ioBlobCallback<64 * 1024, false>, kIoRequest, ioBlobResponseLength<64 * 1024>(), kThreshold },
+        { "256KB write", ioBlobCallback<256 * 1024, false>, kIoRequest, ioBlobResponseLength<256 * 1024>() },
+        { "256KB zerocopy", ioBlobCallback<256 * 1024, false>, kIoRequest, ioBlobResponseLength<256 * 1024>(), kThreshold },
+        { "1MB write", ioBlobCallback<1024 * 1024, false>, kIoRequest, ioBlobResponseLength<1024 * 1024>() },
+        { "1MB zerocopy", ioBlobCallback<1024 * 1024, false>, kIoRequest, ioBlobResponseLength<1024 * 1024>(), kThreshold },
+        { "8MB write", ioBlobCallback<8 * 1024 * 1024, false>, kIoRequest, ioBlobResponseLength<8 * 1024 * 1024>() },
+        { "8MB zerocopy", ioBlobCallback<8 * 1024 * 1024, false>, kIoRequest, ioBlobResponseLength<8 * 1024 * 1024>(),
+          kThreshold },
+    };
+    Logger::setLogLevel(Logger::WARN);
+    unsetenv("USE_IO_URING");
+    printf("%d connections, %d s each, 1 request in flight per connection\n", numConns, seconds);
+    int port = 23490;
+    for (const IoWorkload& workload : workloads) {
+        runIoBench(workload.name, workload, false, numConns, seconds, port++);
+    }
+}
+
+// 发一个 keep-alive 请求并读完响应，连接保持打开
+int idleClient(int port, const char* request) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0
+        || ::write(fd, request, strlen(request)) != static_cast<ssize_t>(strlen(request))) {
+        perror("idleClient");
+        ::close(fd);
+        return -1;
+    }
+    std::string response;
+    char buf[16 * 1024];
+    size_t expected = std::string::npos;
+    while (response.size() < expected) {
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        response.append(buf, n);
+        size_t end = response.find("\r\n\r\n");
+        size_t cl = response.find("Content-Length: ");
+        if (expected == std::string::npos && end != std::string::npos && cl != std::string::npos) {
+            expected = end + 4 + strtoul(response.c_str() + cl + 16, nullptr, 10);
+        }
+    }
+    return fd;
+}
+
+int64_t processRssKb() {
+    FILE* fp = fopen("/proc/self/status", "r");
+    char line[128];
+    long long kb = 0;
+    while (fp != nullptr && fgets(line, sizeof(line), fp) != nullptr) {
+        if (sscanf(line, "VmRSS: %lld", &kb) == 1) {
+            break;
+        }
+    }
+    if (fp != nullptr) {
+        fclose(fp);
+    }
+    return kb;
+}
+
+// numConns 个 keep-alive 连接各完成一个请求后保持空闲，统计服务端每个连接占用的内存，需在仓库根目录运行
+void benchIdle(int numConns) {
+    const int port = 23480;
+    const char* request = "GET /index.html HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+    Logger::setLogLevel(Logger::WARN);
+    EventLoop loop;
+    std::shared_ptr<HttpConfig> config = std::make_shared<HttpConfig>();
+    config->responseCache = std::make_shared<ResponseCache>(config->responseCacheCapacity,
+                                                            config->responseCacheMaxObjectSize);
+    HttpConnectionPool::initLoop(&loop, config);
+    TcpServer server(&loop, InetAddress(port), "bench_idle");
+    std::map<std::string, TcpConnectionPtr> conns;  // 只在 loop 线程中访问
+    server.setConnectionCallback([&conns](const TcpConnectionPtr& conn) {
+        if (conn->connected()) {
+            conns[conn->name()] = conn;
+        }
+        else {
+            conns.erase(conn->name());
+        }
+        onConnection(conn);
+    });
+    server.setMessageCallback(onMessage);
+    server.start();
+
+    Thread controller([&] {
+        ::close(idleClient(port, request));  // 预热各级缓存
+        sleep(1);
+        int64_t rss0 = processRssKb();
+        std::vector<int> fds;
+        for (int i = 0; i < numConns; ++i) {
+            int fd = idleClient(port, request);
+            if (fd < 0) {
+                break;
+            }
+            fds.push_back(fd);
+        }
+        sleep(1);
+        int64_t rss1 = processRssKb();
+
+        CountDownLatch latch(1);
+        loop.runInLoop([&] {
+            size_t tcpBytes = 0, httpBytes = 0;
+            for (const auto& entry : conns) {
+                tcpBytes += entry.second->memoryUsage();
+                httpBytes += boost::any_cast<HttpConnection*>(entry.second->getContext())->memoryUsage();
+            }
+            double n = static_cast<double>(conns.size());
+            printf("%zu idle connections: RSS %.0f bytes/conn, TcpConnection %.0f bytes/conn, "
+                   "HttpConnection %.0f bytes/conn, pool idle %zu bytes\n",
+                   conns.size(), (rss1 - rss0) * 1024.0 / n, tcpBytes / n, httpBytes / n,
+                   loop.bufferPool()->idleBytes());
+            latch.countDown();
+        });
+        latch.wait();
+        for (int fd : fds) {
+            ::close(fd);
+        }
+        sleep(1);
+        loop.quit();
+    }, "bench_idle");
+    controller.start();
+    loop.loop();
+    controller.join();
+}
+
+void benchQueue(int numProducers, int perProducer) {
+    const int kBatch = 64;
+    Logger::setLogLevel(Logger::WARN);
+    printf("%d producers x %d functors\n", numProducers, perProducer);
+    for (int batch = 0; batch < 2; ++batch) {
+        EventLoopThread loopThread;
+        EventLoop* loop = loopThread.startLoop();
+        int64_t iter0 = loop->iteration();
+        std::atomic<int64_t> executed(0);
+        std::atomic<int64_t> wakeups(0);
+        int64_t total = static_cast<int64_t>(numProducers) * perProducer;
+        CountDownLatch done(1);
+        auto task = [&] {
+            if (++executed == total) {
+                done.countDown();
+            }
+        };
+
+        std::vector<std::unique_ptr<Thread>> producers;
+        Timestamp start = Timestamp::now();
+        for (int i = 0; i < numProducers; ++i) {
+            producers.emplace_back(new Thread([&, batch] {
+                int64_t sys0 = threadRwSyscalls();
+                std::vector<EventLoop::Functor> functors;
+                for (int k = 0; k < perProducer; ++k) {
+                    if (batch) {
+                        functors.push_back(task);
+                        if (functors.size() == kBatch || k == perProducer - 1) {
+                            loop->queueBatchInLoop(&functors);
+                        }
+                    }
+                    else {
+                        loop->queueInLoop(task);
+                    }
+                }
+                wakeups += threadRwSyscalls() - sys0;
+            }));
+            producers.back()->start();
+        }
+        for (auto& producer : producers) {
+            producer->join();
+        }
+        done.wait();
+        double sec = static_cast<double>(Timestamp::now().microSecondsSinceEpoch()
+                                         - start.microSecondsSinceEpoch()) / 1e6;
+        printf("%-18s %10.0f functors/s  %7.2f eventfd writes/1k functors  %6.2f functors/loop iteration\n",
+               batch ? "queueBatchInLoop" : "queueInLoop", total / sec,
+               static_cast<double>(wakeups) * 1000 / total,
+               static_cast<double>(total) / static_cast<double>(loop->iteration() - iter0));
+    }
+}
+
+bool g_countAllocs = false;
+size_t g_numAllocs = 0;
+
+void* operator new(size_t n) {
+    if (g_countAllocs) {
+        ++g_numAllocs;
+    }
+    void* p = malloc(n);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// 上面的 operator new 用 malloc 分配，内联到调用处后 GCC 认不出这一对，误报 new/free 不匹配
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+#pragma GCC diagnostic pop
+
+size_t countKeepAliveAllocs(const HttpConfig& config, const char* request) {
+    EventLoop loop;  // FileCache 的 inotify 需要挂在 loop 上，这里不运行 loop
+    FileCache fileCache(&loop, config.sourceDir);
+    GzipCompressor compressor(config.gzipLevel, config.gzipCacheCapacity);
+    HttpConnection http(config, &fileCache, &compressor);
+    Buffer input(4096), output(16*1024);
+
+    for (int i = 0; i < 3; ++i) {  // 预热，让 Buffer/Arena 达到稳态容量，并填充缓存
+        input.append(request, strlen(request));
+        bool close = http.handleMessage(&input, &output);
+        assert(!close && input.readableBytes() == 0); (void)close;
+        output.retrieveAll();
+    }
+
+    g_numAllocs = 0;
+    g_countAllocs = true;
+    for (int i = 0; i < 1000; ++i) {
+        input.append(request, strlen(request));
+        http.handleMessage(&input, &output);
+        output.retrieveAll();
+    }
+    g_countAllocs = false;
+    return g_numAllocs;
+}
+
+// 在 loop 线程中经 TcpConnection::send 发出 size 字节的响应，socket 有空间时应直接从 Buffer 写出，不申请内存
+size_t countSendAllocs(size_t size) {
+    EventLoop loop;
+    int fds[2];
+    int ret = ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+    assert(ret == 0); (void)ret;
+    TcpConnectionPtr conn = std::make_shared<TcpConnection>(&loop, "send", fds[0], InetAddress(), InetAddress());
+    conn->setConnectionCallback([](const TcpConnectionPtr&) {});
+    conn->connectEstablished();
+    std::string body(size, 'x');
+    std::vector<char> sink(size);
+    Buffer response(loop.bufferPool());
+
+    g_numAllocs = 0;
+    for (int i = 0; i < 1003; ++i) {
+        g_countAllocs = i >= 3;  // 前几次让 pool 中有了对应大小的块
+        response.append(body.data(), body.size());
+        conn->send(std::move(response));
+        response.release();
+        ssize_t n = ::read(fds[1], sink.data(), sink.size());
+        assert(n == static_cast<ssize_t>(size)); (void)n;
+    }
+    g_countAllocs = false;
+    conn->connectDestroyed();
+    ::close(fds[1]);
+    return g_numAllocs;
+}
+
+// 其他线程逐个 queueInLoop，每次等回调执行后再投递下一个；MpscQueue 的节点循环使用，不申请内存
+size_t countQueueAllocs() {
+    EventLoopThread loopThread;
+    EventLoop* loop = loopThread.startLoop();
+    std::atomic<int> executed(0);
+    g_numAllocs = 0;
+    for (int i = 0; i < 1003; ++i) {
+        g_countAllocs = i >= 3;  // 前几次让本线程缓存了空闲节点
+        loop->queueInLoop([&executed] { ++executed; });
+        while (executed != i + 1) {
+        }
+    }
+    g_countAllocs = false;
+    return g_numAllocs;
+}
+
+void testKeepAliveNoMalloc() {  // 需在仓库根目录运行，以找到 ./resources
+    const char* request = "GET /index.html HTTP/1.1\r\nConnection: keep-alive\r\n"
+                          "Accept: text/html\r\nUser-Agent: test\r\n\r\n";
+    HttpConfig config;
+    size_t allocs = countKeepAliveAllocs(config, request);
+    printf("keep-alive GET: %zu heap allocations in 1000 requests\n", allocs);
+    assert(allocs == 0);
+
+    config.responseCache = std::make_shared<ResponseCache>(1024 * 1024, 64 * 1024);
+    allocs = countKeepAliveAllocs(config, request);
+    printf("keep-alive GET (ResponseCache hit): %zu heap allocations in 1000 requests, %s\n",
+           allocs, config.responseCache->stats().c_str());
+    assert(allocs == 0 && config.responseCache->hits() >= 1000);
+
+    // 浏览器重复访问时带上次的 Last-Modified，应直接返回 304
+    char date[HttpHeaders::kDateLength + 1];
+    HttpHeaders::formatDate(::time(nullptr), date);
+    char conditional[256];
+    snprintf(conditional, sizeof(conditional), "GET /index.html HTTP/1.1\r\nConnection: keep-alive\r\n"
+             "If-Modified-Since: %s\r\n\r\n", date);
+    allocs = countKeepAliveAllocs(config, conditional);
+    printf("keep-alive conditional GET (304): %zu heap allocations in 1000 requests\n", allocs);
+    assert(allocs == 0);
+
+    allocs = countSendAllocs(10 * 1024);
+    printf("TcpConnection::send(Buffer&&) 10 KB: %zu heap allocations in 1000 responses\n", allocs);
+    assert(allocs == 0);
+
+    allocs = countQueueAllocs();
+    printf("EventLoop::queueInLoop from another thread: %zu heap allocations in 1000 functors\n", allocs);
+    assert(allocs == 0);
+}
+
+struct TaskSink {
+    int64_t hits = 0;
+    void hit(const std::shared_ptr<int>&) { ++hits; }
+};
+
+// 每轮 loop 投递 kChunk 个回调，保持与实际相近的队列长度
+struct TaskChunks {
+    static const int kChunk = 1000;
+    EventLoop* loop;
+    TaskSink* sink;
+    std::shared_ptr<int> guard;
+    int remaining;
+    bool timers;
+    CountDownLatch* done;
+
+    void step() {
+        for (int i = 0; i < kChunk && remaining > 0; ++i, --remaining) {
+            if (timers) {
+                loop->cancel(loop->runAfter(std::bind(&TaskSink::hit, sink, guard), 60));
+            }
+            else {
+                loop->queueInLoop(std::bind(&TaskSink::hit, sink, guard));
+            }
+        }
+        if (remaining > 0) {
+            loop->queueInLoop(std::bind(&TaskChunks::step, this));
+        }
+        else {
+            loop->queueInLoop([this] { g_countAllocs = false; done->countDown(); });
+        }
+    }
+};
+
+// EventLoop::Functor / TimerCallback 的吞吐和每次操作的堆分配次数，回调为常见的 std::bind(&Class::method, this, shared_ptr)
+void benchTask(int rounds) {
+    Logger::setLogLevel(Logger::WARN);
+    EventLoopThread loopThread;
+    EventLoop* loop = loopThread.startLoop();
+    TaskSink sink;
+    std::shared_ptr<int> guard = std::make_shared<int>(0);
+    printf("callable: %zu bytes, EventLoop::Functor: %zu bytes\n",
+           sizeof(std::bind(&TaskSink::hit, &sink, guard)), sizeof(EventLoop::Functor));
+
+    const char* names[] = { "queueInLoop (loop thread)", "runAfter + cancel", "queueInLoop (other thread)" };
+    for (int k = 0; k < 3; ++k) {
+        CountDownLatch done(1);
+        Timestamp start;
+        g_numAllocs = 0;
+        TaskChunks chunks{ loop, &sink, guard, rounds, k == 1, &done };
+        if (k < 2) {
+            loop->runInLoop([&] {
+                start = Timestamp::now();
+                g_countAllocs = true;
+                chunks.step();
+            });
+        }
+        else {
+            start = Timestamp::now();
+            g_countAllocs = true;
+            for (int i = 0; i < rounds; ++i) {
+                loop->queueInLoop(std::bind(&TaskSink::hit, &sink, guard));
+            }
+            loop->queueInLoop([&] { g_countAllocs = false; done.countDown(); });
+        }
+        done.wait();
+        double sec = static_cast<double>(Timestamp::now().microSecondsSinceEpoch()
+                                         - start.microSecondsSinceEpoch()) / 1e6;
+        printf("%-28s %10.0f ops/s  %5.2f heap allocations/op\n",
+               names[k], rounds / sec, static_cast<double>(g_numAllocs) / rounds);
+    }
+}
+
+// 在 Buffer 上驱动 HttpConnection，不经过 socket；conn 为空时文件内容都拷贝进 output。需在仓库根目录运行，以找到 ./resources
+class HttpDriver {
+ public:
+    explicit HttpDriver(const HttpConfig& config)
+      : fileCache_(&loop_, config.sourceDir),
+        compressor_(config.gzipLevel, config.gzipCacheCapacity),
+        http_(config, &fileCache_, &compressor_),
+        closed_(false) {}
+
+    // 追加一段请求数据并处理，返回这次产生的输出
+    std::string feed(const std::string& data) {
+        assert(!closed_);
+        input_.append(data.data(), data.size());
+        closed_ = http_.handleMessage(&input_, &output_);
+        return output_.retrieveAllAsString();
+    }
+
+    bool closed() const { return closed_; }
+    size_t pending() const { return input_.readableBytes(); }  // 还没有处理的请求数据
+
+ private:
+    EventLoop loop_;  // FileCache 的 inotify 需要挂在 loop 上，这里不运行 loop
+    FileCache fileCache_;
+    GzipCompressor compressor_;
+    HttpConnection http_;
+    Buffer input_, output_;
+    bool closed_;
+};
+
+struct HttpResponse {
+    int status;
+    std::string header;  // 状态行和首部，每行以 CRLF 结尾
+    std::string body;
+
+    std::string field(const char* name) const {  // 不存在时返回空
+        std::string key = std::string("\r\n") + name + ": ";
+        size_t pos = header.find(key);
+        if (pos == std::string::npos) {
+            return std::string();
+        }
+        pos += key.size();
+        return header.substr(pos, header.find("\r\n", pos) - pos);
+    }
+};
+
+// 按 Content-Length 切分 output 中依次排列的响应，1xx 和 304 没有 body
+std::vector<HttpResponse> parseResponses(std::string out) {
+    std::vector<HttpResponse> responses;
+    while (!out.empty()) {
+        size_t end = out.find("\r\n\r\n");
+        assert(end != std::string::npos && out.compare(0, 9, "HTTP/1.1 ") == 0);
+        HttpResponse response;
+        response.status = atoi(out.c_str() + 9);
+        response.header = out.substr(0, end + 2);
+        size_t length = 0;
+        if (response.status >= 200 && response.status != 304) {
+            length = strtoul(response.field("Content-Length").c_str(), nullptr, 10);
+        }
+        response.body = out.substr(end + 4, length);
+        assert(response.body.size() == length);
+        out.erase(0, end + 4 + length);
+        responses.push_back(response);
+    }
+    return responses;
+}
+
+std::vector<int> statusCodes(const std::string& out) {
+    std::vector<int> codes;
+    for (const HttpResponse& response : parseResponses(out)) {
+        codes.push_back(response.status);
+    }
+    return codes;
+}
+
+void testHttpParser() {
+    HttpConfig config;
+    const std::string get = "GET /index.html?x=1 HTTP/1.1\r\nHost: a\r\nConnection: keep-alive\r\nX-Empty:\r\n\r\n";
+
+    // 逐字节到达时每次只扫描新数据，完成后 view 指向 input buffer
+    {
+        HttpParser parser;
+        Buffer buf;
+        for (size_t i = 0; i + 1 < get.size(); ++i) {
+            buf.append(&get[i], 1);
+            assert(parser.parse(&buf) == HttpParser::kIncomplete);
+        }
+        buf.append(&get.back(), 1);
+        assert(parser.parse(&buf) == HttpParser::kComplete && parser.finished());
+        assert(parser.method() == "GET" && parser.path() == "/index.html?x=1" && parser.version() == "1.1");
+        assert(parser.header(HttpHeaders::kHost) == "a" && parser.header(HttpHeaders::kConnection) == "keep-alive");
+        assert(parser.findHeader("x-empty").empty() && parser.findHeader("X-Missing").empty());
+        assert(parser.headerLength() == get.size());
+    }
+
+    // 请求行或首部行格式错误时 parse() 返回 kError，不再等待后续数据
+    const char* malformedLines[] = {
+        "GET\r\n\r\n",
+        "GET /index.html\r\n\r\n",
+        "GET /index.html HTTP/1.1 extra\r\n\r\n",
+        "GET  /index.html HTTP/1.1\r\n\r\n",
+        "GET /index.html FTP/1.1\r\n\r\n",
+        "GET /index.html HTTP/1.1\r\nHost a\r\n\r\n",
+    };
+    for (const char* request : malformedLines) {
+        HttpParser parser;
+        Buffer buf;
+        buf.append(request, strlen(request));
+        assert(parser.parse(&buf) == HttpParser::kError);
+    }
+    {
+        HttpParser parser;
+        Buffer buf;
+        std::string request = "GET /index.html HTTP/1.1\r\nX-Long: " + std::string(HttpParser::kMaxHeaderSize, 'x');
+        buf.append(request.data(), request.size());
+        assert(parser.parse(&buf) == HttpParser::kError);
+    }
+
+    // 拆成单个字节交给 HttpConnection，只在最后一个字节到达后响应
+    {
+        HttpDriver driver(config);
+        for (size_t i = 0; i + 1 < get.size(); ++i) {
+            assert(driver.feed(get.substr(i, 1)).empty());
+        }
+        std::vector<HttpResponse> responses = parseResponses(driver.feed(get.substr(get.size() - 1)));
+        assert(responses.size() == 1 && responses[0].status == 200 && !responses[0].body.empty());
+        assert(!driver.closed() && driver.pending() == 0);
+    }
+
+    // pipelining：一次到达的多个请求按顺序响应，末尾不完整的请求留在 input buffer 中等待后续数据
+    {
+        HttpDriver driver(config);
+        const std::string missing = "GET /missing.html HTTP/1.1\r\nConnection: keep-alive\r\n\r\n";
+        assert(statusCodes(driver.feed(get + missing + get + "GET /index")) == std::vector<int>({ 200, 404, 200 }));
+        assert(!driver.closed() && driver.pending() == strlen("GET /index"));
+        assert(statusCodes(driver.feed(".html HTTP/1.1\r\n\r\n")) == std::vector<int>({ 200 }));
+        assert(driver.closed());  // 没有 Connection: keep-alive
+    }
+
+    // 格式错误的请求：400 并关闭连接，不处理后面的数据
+    const char* malformed[] = {
+        "GET\r\n\r\n",
+        "GET /index.html\r\n\r\n",
+        "GET /index.html HTTP/1.1 extra\r\n\r\n",
+        "GET  /index.html HTTP/1.1\r\n\r\n",
+        "GET /index.html FTP/1.1\r\n\r\n",
+        "GET index.html HTTP/1.1\r\n\r\n",
+        "GET /../index.html HTTP/1.1\r\n\r\n",
+        "GET /index.html HTTP/1.1\r\nHost a\r\n\r\n",
+        "GET /index.html HTTP/1.1\r\nConnection: keep-alive\r\nContent-Length: 1x\r\n\r\n",
+    };
+    for (const char* request : malformed) {
+        HttpDriver driver(config);
+        std::string out = driver.feed(std::string(request) + "GET /index.html HTTP/1.1\r\n\r\n");
+        assert(statusCodes(out) == std::vector<int>({ 400 }));
+        assert(driver.closed());
+    }
+
+    // 首部超过 HttpParser::kMaxHeaderSize 时不再等待
+    {
+        HttpDriver driver(config);
+        std::string out = driver.feed("GET /index.html HTTP/1.1\r\nX-Long: " + std::string(HttpParser::kMaxHeaderSize, 'x'));
+        assert(statusCodes(out) == std::vector<int>({ 400 }) && driver.closed());
+    }
+    printf("testHttpParser passed\n");
+}
+
+void testHttpBody() {
+    HttpConfig config;
+
+    // chunk-ext 和 trailer 被跳过，逐字节到达时同样解码，请求体之后的数据留在 buffer 中
+    {
+        const std::string encoded = "5;name=\"v\"\r\nhello\r\n6 ; ext\r\n world\r\n0\r\nX-Trailer: 1\r\nX-Other: 2\r\n\r\nGET";
+        HttpBody body(config);
+        body.startChunked();
+        Buffer buf;
+        HttpBody::Result result = HttpBody::kNeedMore;
+        for (size_t i = 0; i < encoded.size() && result == HttpBody::kNeedMore; ++i) {
+            buf.append(&encoded[i], 1);
+            result = body.consume(&buf);
+        }
+        assert(result == HttpBody::kDone && body.data() == "hello world" && body.size() == 11);
+        buf.append("/", 1);
+        assert(buf.retrieveAllAsString() == "/");  // 结束后读到的字节不再属于请求体
+    }
+
+    const char* badChunks[] = {
+        "zz\r\n",                 // 非十六进制
+        "5x\r\nhello\r\n",        // size 之后不是 chunk-ext
+        "5\r\nhelloXX",           // 数据后缺少 CRLF
+        "fffffffffffffffff\r\n",  // 溢出
+    };
+    for (const char* encoded : badChunks) {
+        HttpBody body(config);
+        body.startChunked();
+        Buffer buf;
+        buf.append(encoded, strlen(encoded));
+        assert(body.consume(&buf) == HttpBody::kError);
+    }
+    {
+        HttpBody body(config);
+        body.startChunked();
+        Buffer buf;
+        std::string line(4096, '0');  // 超过 chunk-size 行的长度上限，不再等待 CRLF
+        buf.append(line.data(), line.size());
+        assert(body.consume(&buf) == HttpBody::kError);
+    }
+
+    // 超过 bodySpillThreshold 的请求体转存到临时文件，内容不变，内存预算全部归还
+    {
+        HttpConfig small;
+        small.bodySpillThreshold = 8;
+        HttpBody body(small);
+        body.startLength(20);
+        Buffer buf;
+        buf.append("0123", 4);
+        assert(body.consume(&buf) == HttpBody::kNeedMore && !body.spilled() && small.inflightBodyMemory == 4);
+        buf.append("456789abcdefghij", 16);
+        assert(body.consume(&buf) == HttpBody::kDone && body.spilled());
+        char spilled[21] = { 0 };
+        assert(::pread(body.spillFd(), spilled, 20, 0) == 20 && strcmp(spilled, "0123456789abcdefghij") == 0);
+        assert(small.inflightBodyMemory == 0);
+    }
+
+    const std::string form = "POST /login.html HTTP/1.1\r\nConnection: keep-alive\r\n"
+                             "Content-Type: application/x-www-form-urlencoded\r\n";
+
+    // 分块上传的表单，chunk 边界落在 %XX 中间，之后 pipelining 的请求照常处理
+    {
+        HttpDriver driver(config);
+        assert(driver.feed(form + "Transfer-Encoding: chunked\r\n\r\n7;x=y\r\nuser=%4\r\n").empty());
+        std::string out = driver.feed("8\r\n1&pass=b\r\n0\r\nX-Trailer: 1\r\n\r\nGET /index.html HTTP/1.1\r\n\r\n");
+        assert(statusCodes(out) == std::vector<int>({ 200, 200 }));
+    }
+
+    // Expect: 100-continue 在读请求体之前先回 100；提前拒绝的请求不回 100
+    {
+        HttpDriver driver(config);
+        std::string out = driver.feed(form + "Expect: 100-continue\r\nContent-Length: 12\r\n\r\n");
+        assert(out == "HTTP/1.1 100 Continue\r\n\r\n");
+        assert(statusCodes(driver.feed("user=a&pass=")) == std::vector<int>({ 400 }));  // 值为空
+    }
+    {
+        HttpDriver driver(config);
+        std::string out = driver.feed("POST /missing.html HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 10\r\n\r\n");
+        assert(statusCodes(out) == std::vector<int>({ 404 }) && driver.closed());
+    }
+
+    // 同时带 Transfer-Encoding 和 Content-Length 可能是请求走私
+    {
+        HttpDriver driver(config);
+        std::string out = driver.feed(form + "Transfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n0\r\n\r\n");
+        assert(statusCodes(out) == std::vector<int>({ 400 }) && driver.closed());
+    }
+    {
+        HttpDriver driver(config);
+        std::string out = driver.feed(form + "Transfer-Encoding: gzip, chunked\r\n\r\n0\r\n\r\n");
+        assert(statusCodes(out) == std::vector<int>({ 400 }) && driver.closed());
+    }
+
+    // 413：Content-Length 超过 maxBodySize 时不等请求体；chunked 累计超过时中途拒绝；表单解码结果超过 bodySpillThreshold
+    {
+        HttpConfig small;
+        small.maxBodySize = 16;
+        small.bodySpillThreshold = 8;
+        {  // 每个线程只能有一个 EventLoop，driver 依次构造
+            HttpDriver driver(small);
+            assert(statusCodes(driver.feed(form + "Expect: 100-continue\r\nContent-Length: 17\r\n\r\n"))
+                   == std::vector<int>({ 413 }));
+            assert(driver.closed());
+        }
+        {
+            HttpDriver driver(small);
+            assert(driver.feed("POST /index.html HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\na\r\n0123456789\r\n").empty());
+            assert(statusCodes(driver.feed("7\r\nabcdefg\r\n")) == std::vector<int>({ 413 }));
+            assert(driver.closed());
+        }
+        {
+            HttpDriver driver(small);
+            assert(statusCodes(driver.feed(form + "Content-Length: 12\r\n\r\nuser=abcdefg")) == std::vector<int>({ 413 }));
+            assert(driver.closed());
+        }
+        assert(small.inflightBodyMemory == 0);
+    }
+    printf("testHttpBody passed\n");
+}
+
+std::string readWholeFile(const char* path) {
+    std::string content;
+    FILE* fp = fopen(path, "rb");
+    assert(fp != nullptr);
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        content.append(buf, n);
+    }
+    fclose(fp);
+    return content;
+}
+
+void testHttpRange() {
+    HttpConfig config;
+    HttpDriver driver(config);
+    const std::string file = readWholeFile("./resources/index.html");
+    const std::string size = std::to_string(file.size());
+    auto get = [&driver](const std::string& headers) {
+        std::vector<HttpResponse> responses =
+            parseResponses(driver.feed("GET /index.html HTTP/1.1\r\nConnection: keep-alive\r\n" + headers + "\r\n"));
+        assert(responses.size() == 1 && !driver.closed());
+        return responses[0];
+    };
+
+    HttpResponse full = get("");
+    assert(full.status == 200 && full.body == file && full.field("Accept-Ranges") == "bytes");
+    const std::string etag = full.field("ETag");
+    assert(etag.size() > 2 && etag.front() == '"');
+
+    struct {
+        const char* range;
+        size_t first, last;
+    } singles[] = {
+        { "bytes=0-99", 0, 99 },
+        { "bytes=-100", file.size() - 100, file.size() - 1 },
+        { "bytes=3000-", 3000, file.size() - 1 },
+        { "bytes=100-999999", 100, file.size() - 1 },  // 末尾超出文件时截断
+        { "bytes=0-99, 50-149,150-199", 0, 199 },      // 重叠和相邻的范围合并为一个
+        { "bytes=999999-,10-19", 10, 19 },             // 跳过不可满足的范围
+        { "BYTES=5-5", 5, 5 },
+    };
+    for (const auto& single : singles) {
+        HttpResponse response = get(std::string("Range: ") + single.range + "\r\n");
+        assert(response.status == 206);
+        assert(response.field("Content-Range") == "bytes " + std::to_string(single.first) + "-"
+                                                  + std::to_string(single.last) + "/" + size);
+        assert(response.body == file.substr(single.first, single.last - single.first + 1));
+    }
+
+    // 不相交的多个范围按起点排序后以 multipart/byteranges 发送
+    {
+        HttpResponse response = get("Range: bytes=100-109,0-9,5-12\r\n");
+        const std::string kType = "multipart/byteranges; boundary=";
+        std::string type = response.field("Content-Type");
+        assert(response.status == 206 && type.compare(0, kType.size(), kType) == 0);
+        std::string boundary = type.substr(kType.size());
+        std::string expected = "\r\n--" + boundary + "\r\nContent-Type: text/html\r\nContent-Range: bytes 0-12/" + size
+                               + "\r\n\r\n" + file.substr(0, 13)
+                               + "\r\n--" + boundary + "\r\nContent-Type: text/html\r\nContent-Range: bytes 100-109/" + size
+                               + "\r\n\r\n" + file.substr(100, 10) + "\r\n--" + boundary + "--\r\n";
+        assert(response.body == expected);
+    }
+
+    // 全部不可满足：416，Content-Range 给出完整长度
+    const char* unsatisfiable[] = { "bytes=999999-", "bytes=999999-1000000, 888888-", "bytes=-0" };
+    for (const char* range : unsatisfiable) {
+        HttpResponse response = get(std::string("Range: ") + range + "\r\n");
+        assert(response.status == 416 && response.field("Content-Range") == "bytes */" + size);
+    }
+
+    // 语法错误或范围过多时忽略 Range，返回完整文件
+    std::string tooMany = "bytes=0-0";
+    for (int i = 1; i <= 16; ++i) {
+        tooMany += "," + std::to_string(i * 10) + "-" + std::to_string(i * 10);
+    }
+    const char* ignored[] = { "bytes=abc", "bytes=10-5", "bytes=5", "items=0-9", tooMany.c_str() };
+    for (const char* range : ignored) {
+        HttpResponse response = get(std::string("Range: ") + range + "\r\n");
+        assert(response.status == 200 && response.body == file);
+    }
+
+    // If-Range 只做强比较，不匹配时返回完整文件
+    assert(get("Range: bytes=0-9\r\nIf-Range: " + etag + "\r\n").status == 206);
+    assert(get("Range: bytes=0-9\r\nIf-Range: W/" + etag + "\r\n").status == 200);
+    assert(get("Range: bytes=0-9\r\nIf-Range: \"other\"\r\n").status == 200);
+    assert(get("Range: bytes=0-9\r\nIf-Range: " + full.field("Last-Modified") + "\r\n").status == 206);
+    assert(get("Range: bytes=0-9\r\nIf-Range: Thu, 01 Jan 1970 00:00:00 GMT\r\n").status == 200);
+    printf("testHttpRange passed\n");
+}
+
+void testHttpConditional() {
+    HttpConfig config;
+    HttpDriver driver(config);
+    auto get = [&driver](const char* path, const std::string& headers) {
+        std::vector<HttpResponse> responses = parseResponses(driver.feed(
+            std::string("GET ") + path + " HTTP/1.1\r\nConnection: keep-alive\r\n" + headers + "\r\n"));
+        assert(responses.size() == 1 && !driver.closed());
+        return responses[0];
+    };
+
+    HttpResponse full = get("/index.html", "");
+    const std::string etag = full.field("ETag"), lastModified = full.field("Last-Modified");
+    assert(full.status == 200 && etag.size() > 2 && etag.front() == '"' && etag.back() == '"' && !lastModified.empty());
+    assert(full.field("Cache-Control") == "no-cache");  // defaultMaxAge 为 0
+    assert(get("/css/style.css", "").field("Cache-Control") == "max-age=604800");
+
+    // If-None-Match 做弱比较，304 带校验器但没有 body 和描述 body 的首部
+    const std::string matching[] = { etag, "W/" + etag, "\"other\", " + etag, "\"other\",W/" + etag, "*" };
+    for (const std::string& tag : matching) {
+        HttpResponse response = get("/index.html", "If-None-Match: " + tag + "\r\n");
+        assert(response.status == 304 && response.body.empty());
+        assert(response.field("ETag") == etag && response.field("Content-Length").empty());
+    }
+    const std::string mismatching[] = { "\"other\"", "W/\"other\"", etag.substr(0, etag.size() - 1) + "x\"" };
+    for (const std::string& tag : mismatching) {
+        assert(get("/index.html", "If-None-Match: " + tag + "\r\n").status == 200);
+    }
+
+    // If-None-Match 存在时忽略 If-Modified-Since
+    assert(get("/index.html", "If-None-Match: \"other\"\r\nIf-Modified-Since: " + lastModified + "\r\n").status == 200);
+    assert(get("/index.html", "If-Modified-Since: " + lastModified + "\r\n").status == 304);
+    assert(get("/index.html", "If-Modified-Since: Thu, 01 Jan 1970 00:00:00 GMT\r\n").status == 200);
+    assert(get("/index.html", "If-Modified-Since: Fri, 01 Jan 2100 00:00:00 GMT\r\n").status == 200);  // 晚于当前时间无效
+    assert(get("/index.html", "If-Modified-Since: yesterday\r\n").status == 200);
+
+    // 压缩后的表示有不同的 ETag，两种表示的校验器不能互相匹配
+    HttpResponse gzip = get("/index.html", "Accept-Encoding: gzip\r\n");
+    const std::string gzipETag = gzip.field("ETag");
+    assert(gzip.status == 200 && gzip.field("Content-Encoding") == "gzip" && gzip.field("Vary") == "Accept-Encoding");
+    assert(!gzipETag.empty() && gzipETag != etag);
+    assert(get("/index.html", "Accept-Encoding: gzip\r\nIf-None-Match: " + gzipETag + "\r\n").status == 304);
+    assert(get("/index.html", "Accept-Encoding: gzip\r\nIf-None-Match: " + etag + "\r\n").status == 200);
+    assert(get("/index.html", "If-None-Match: " + gzipETag + "\r\n").status == 200);
+    printf("testHttpConditional passed\n");
+}
+
+void writeWholeFile(const std::string& path, const std::string& content) {
+    FILE* fp = fopen(path.c_str(), "wb");
+    assert(fp != nullptr);
+    size_t n = fwrite(content.data(), 1, content.size(), fp);
+    assert(n == content.size()); (void)n;
+    fclose(fp);
+}
+
+// 未知扩展名按 application/octet-stream 判断，预压缩和动态压缩都跳过
+void testHttpCompression() {
+    char dir[] = "/tmp/httpgzip-XXXXXX";
+    assert(::mkdtemp(dir) != nullptr);
+    std::string text;
+    for (int i = 0; i < 200; ++i) {
+        text += "compressible line " + std::to_string(i) + "\n";
+    }
+    const char* names[] = { "/notes.txt", "/data.bin", "/pre.txt", "/pre.bin" };
+    for (const char* name : names) {
+        writeWholeFile(dir + std::string(name), text);
+    }
+    assert(Compression::precompressTree(dir, 1024) == 2);  // notes.txt 与 pre.txt
+    struct stat st;
+    assert(::stat((dir + std::string("/pre.txt.gz")).c_str(), &st) == 0);
+    assert(::stat((dir + std::string("/pre.bin.gz")).c_str(), &st) < 0);
+    {
+        HttpConfig config;
+        config.sourceDir = dir;
+        HttpDriver driver(config);
+        auto get = [&driver](const char* path) {
+            std::vector<HttpResponse> responses = parseResponses(driver.feed(
+                std::string("GET ") + path + " HTTP/1.1\r\nConnection: keep-alive\r\nAccept-Encoding: gzip\r\n\r\n"));
+            assert(responses.size() == 1 && responses[0].status == 200);
+            return responses[0];
+        };
+        HttpResponse txt = get("/notes.txt"), bin = get("/data.bin");
+        assert(txt.field("Content-Encoding") == "gzip" && txt.field("Vary") == "Accept-Encoding");
+        assert(bin.field("Content-Encoding").empty() && bin.field("Vary").empty() && bin.body == text);
+        assert(bin.field("Content-Type") == "text/plain");  // 发送时的类型不变
+    }
+
+    std::string noise(4096, '\0');
+    unsigned seed = 1;
+    for (char& c : noise) {
+        c = static_cast<char>(rand_r(&seed));
+    }
+
+    // 动态压缩按文件身份缓存：命中时不读文件（fd 传 -1 也能取到），文件改变后重新压缩；不可压缩的文件缓存空结果
+    {
+        GzipCompressor compressor(6, 1024 * 1024);
+        std::string path = dir + std::string("/notes.txt");
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        assert(fd >= 0 && ::fstat(fd, &st) == 0);
+        GzipCompressor::Output first = compressor.compressFile(fd, st);
+        assert(first && first->size() < text.size() && compressor.misses() == 1);
+        assert(compressor.compressFile(-1, st) == first && compressor.hits() == 1);
+        ::close(fd);
+
+        writeWholeFile(path, text + text);
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        assert(fd >= 0 && ::fstat(fd, &st) == 0);
+        GzipCompressor::Output second = compressor.compressFile(fd, st);
+        assert(second && second != first && compressor.misses() == 2);
+        ::close(fd);
+
+        path = dir + std::string("/noise.txt");
+        writeWholeFile(path, noise);
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        assert(fd >= 0 && ::fstat(fd, &st) == 0);
+        assert(!compressor.compressFile(fd, st) && compressor.misses() == 3);
+        assert(!compressor.compressFile(-1, st) && compressor.hits() == 2);
+        ::close(fd);
+    }
+
+    // 压缩后没有变小的文件发送原始内容，ETag 和条件请求也按原始内容，不带 "-gzip"
+    {
+        HttpConfig config;
+        config.sourceDir = dir;
+        HttpDriver driver(config);
+        auto get = [&driver](const std::string& headers) {
+            std::vector<HttpResponse> responses = parseResponses(driver.feed(
+                "GET /noise.txt HTTP/1.1\r\nConnection: keep-alive\r\n" + headers + "\r\n"));
+            assert(responses.size() == 1);
+            return responses[0];
+        };
+        const std::string etag = get("").field("ETag");
+        HttpResponse gzip = get("Accept-Encoding: gzip\r\n");
+        assert(gzip.status == 200 && gzip.field("Content-Encoding").empty() && gzip.field("Vary") == "Accept-Encoding");
+        assert(gzip.body == noise && gzip.field("ETag") == etag);
+        assert(get("Accept-Encoding: gzip\r\nIf-None-Match: " + etag + "\r\n").status == 304);
+        const std::string gzipETag = etag.substr(0, etag.size() - 1) + "-gzip\"";
+        assert(get("Accept-Encoding: gzip\r\nIf-None-Match: " + gzipETag + "\r\n").status == 200);
+    }
+
+    for (const char* name : { "/notes.txt", "/notes.txt.gz", "/data.bin", "/pre.txt", "/pre.txt.gz", "/pre.bin",
+                              "/noise.txt" }) {
+        ::unlink((dir + std::string(name)).c_str());
+    }
+    ::rmdir(dir);
+    printf("testHttpCompression passed\n");
+}
+
+void testHttp() {  // 需在仓库根目录运行，以找到 ./resources
+    Logger::setLogLevel(Logger::WARN);
+    testHttpParser();
+    testHttpBody();
+    testHttpRange();
+    testHttpConditional();
+    testHttpCompression();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench_parser") == 0) {
+        benchRequestParser();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "test_no_malloc") == 0) {
+        testKeepAliveNoMalloc();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "test_http") == 0) {
+        testHttp();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench_io") == 0) {
+        benchIo(argc > 2 ? atoi(argv[2]) : 16, argc > 3 ? atoi(argv[3]) : 3);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench_queue") == 0) {
+        benchQueue(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atoi(argv[3]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench_task") == 0) {
+        benchTask(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench_et") == 0) {
+        benchEdgeTriggered(argc > 2 ? atoi(argv[2]) : 16, argc > 3 ? atoi(argv[3]) : 3);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench_chain") == 0) {
+        benchChain(argc > 2 ? atoi(argv[2]) : 16, argc > 3 ? atoi(argv[3]) : 3);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench_zerocopy") == 0) {
+        benchZeroCopy(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atoi(argv[3]) : 3);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench_idle") == 0) {
+        benchIdle(argc > 2 ? atoi(argv[2]) : 5000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench_search") == 0) {
+        benchSearch();
+        return 0;
+    }
+
     Logger::setLogLevel(Logger::TRACE);
     testTcpServer();
     return 0;